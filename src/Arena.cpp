@@ -0,0 +1,77 @@
+// FILE: Arena.cpp (part of namespace rlair_multi_clustering)
+// CLASS implemented: Arena (see Arena.h for documentation)
+
+#include <cstdlib>                  // provides: malloc, free
+#include <cstring>                  // provides: memset
+#include <new>                      // provides: bad_alloc
+#include <algorithm>                // provides: max
+#include <stdint.h>                 // provides: uintptr_t
+#include "Arena.h"
+
+using namespace std;
+
+namespace rlair_multi_clustering
+{
+  const size_t Arena::ALIGNMENT;
+  const size_t ARENA_BLOCK = 1 << 20;   // fewest bytes of a block
+
+  Arena::Arena() : used(0), total(0) {}
+
+  Arena::Arena(const Arena &) : used(0), total(0) {}
+
+  Arena::~Arena()
+  // Library facilities used: free
+  {
+    for(size_t i = 0; i != blocks.size(); ++i) free(blocks[i]);
+  }
+
+  Arena & Arena::operator=(const Arena &)
+  // Library facilities used: none
+  {return *this;}
+
+  void Arena::reset()
+  // Library facilities used: free, malloc
+  {
+    if(blocks.size() > 1)
+    {
+      for(size_t i = 0; i != blocks.size(); ++i) free(blocks[i]);
+      blocks.assign(1, static_cast<char *>(malloc(total)));
+      sizes.assign(1, total);
+      if(blocks[0] == NULL) {blocks.clear(); sizes.clear();}
+    }
+    used = 0;
+    total = 0;
+  }
+
+  size_t Arena::bytes() const
+  // Library facilities used: none
+  {
+    size_t size = 0;
+    for(size_t i = 0; i != sizes.size(); ++i) size += sizes[i];
+    return size;
+  }
+
+  void * Arena::allocate_bytes(size_t size)
+  // Library facilities used: malloc, memset
+  {
+    // arrays start on ALIGNMENT bytes from the start of a block (malloc
+    // aligns blocks to 16 bytes, so blocks are over-allocated)
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if(blocks.empty() || used + size + ALIGNMENT > sizes.back())
+    {
+      size_t block = max(ARENA_BLOCK, size + ALIGNMENT);
+      char * memory = static_cast<char *>(malloc(block));
+      if(memory == NULL) throw bad_alloc();
+      blocks.push_back(memory);
+      sizes.push_back(block);
+      used = 0;
+    }
+    char * start = blocks.back() + used;
+    size_t skew = size_t(reinterpret_cast<uintptr_t>(start) % ALIGNMENT);
+    if(skew != 0) start += ALIGNMENT - skew;
+    used = size_t(start - blocks.back()) + size;
+    total += size + ALIGNMENT;
+    memset(start, 0, size);
+    return start;
+  }
+}
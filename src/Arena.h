@@ -0,0 +1,59 @@
+// FILE: Arena.h
+// CLASS PROVIDED: Arena (part of the namespace rlair_multi_clustering)
+
+#ifndef RLAIR_MULTI_CLUSTERING_ARENA
+#define RLAIR_MULTI_CLUSTERING_ARENA
+
+#include <vector>                   // provides: vector
+#include <cstddef>                  // provides: size_t
+
+namespace rlair_multi_clustering
+{
+  // Hands out zeroed arrays for the buffers of a sweep from large blocks of
+  // memory that are kept between sweeps. Arrays stay valid until reset,
+  // which makes all the memory available again; when a sweep needed more
+  // than one block, reset replaces them with a single block of the total,
+  // so that later sweeps of the same size allocate nothing.
+  class Arena
+  {
+  public:
+    static const size_t ALIGNMENT = 64;   // bytes (a cache line)
+
+    // CONSTRUCTORS and DESTRUCTOR
+    Arena();
+    Arena(const Arena & source);
+    ~Arena();
+
+    // MODIFICATION MEMBER FUNCTIONS
+    Arena & operator=(const Arena & source);
+    // Precondition: none
+    // Postcondition: *this is unchanged (memory is not shared)
+    template<class U> U * allocate(size_t count)
+    // Precondition: U is a number type
+    // Postcondition: Return value is an array of count zeroes, aligned to
+    // ALIGNMENT bytes, valid until reset
+    // Library facilities used: none
+    {return static_cast<U *>(allocate_bytes(count * sizeof(U)));}
+    void reset();
+    // Precondition: arrays of *this are no longer used
+    // Postcondition: all the memory of *this is available
+
+    // CONSTANT MEMBER FUNCTIONS
+    size_t bytes() const;
+    // Precondition: none
+    // Postcondition: Return value is the memory held by *this
+
+  private:
+    void * allocate_bytes(size_t size);
+    // Precondition: none
+    // Postcondition: Return value is size zero bytes, aligned to ALIGNMENT
+
+    // MEMBER VARIABLES
+    std::vector<char *> blocks;       // memory, the last one in use
+    std::vector<size_t> sizes;        // bytes of each block
+    size_t used;                      // bytes handed out of the last block
+    size_t total;                     // bytes handed out since reset
+  };
+}
+
+#endif
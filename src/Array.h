@@ -0,0 +1,111 @@
+// FILE: Array.h
+// CLASS PROVIDED: Array (part of the namespace rlair_multi_clustering)
+
+#ifndef RLAIR_MULTI_CLUSTERING_ARRAY
+#define RLAIR_MULTI_CLUSTERING_ARRAY
+
+#include <vector>                   // provides: vector
+#include <algorithm>                // provides: equal
+#include <cstddef>                  // provides: size_t
+
+namespace rlair_multi_clustering
+{
+  // Elements of a matrix, either held in a vector or viewed in place in
+  // memory owned elsewhere (a mapped cache file). A view is copied into a
+  // vector of its own the first time it changes size; its elements may be
+  // written in place. Copies always hold their own elements.
+  template<class T>
+  class Array
+  {
+  public:
+    // CONSTRUCTORS
+    Array() : first(NULL), count(0) {}
+    explicit Array(size_t size, const T & value = T())
+    : elements(size, value), first(NULL), count(0) {adopt();}
+    Array(const Array & source)
+    : elements(source.begin(), source.end()), first(NULL), count(0)
+    {adopt();}
+
+    // MODIFICATION MEMBER FUNCTIONS
+    Array & operator=(const Array & source)
+    // Precondition: none
+    // Postcondition: *this holds a copy of the elements of source
+    // Library facilities used: vector
+    {
+      if(this != &source)
+      {
+        std::vector<T> copy(source.begin(), source.end());
+        elements.swap(copy);
+        adopt();
+      }
+      return *this;
+    }
+    void view(T * origin, size_t size)
+    // Precondition: origin points to size elements that stay valid (and
+    // writable) while *this views them
+    // Postcondition: *this views the size elements at origin
+    // Library facilities used: vector
+    {
+      std::vector<T>().swap(elements);
+      first = origin;
+      count = size;
+    }
+    void resize(size_t size)
+    // Precondition: none
+    // Postcondition: *this has size elements, new ones zero
+    // Library facilities used: vector
+    {own(); elements.resize(size); adopt();}
+    void push_back(const T & value)
+    // Precondition: none
+    // Postcondition: value is appended
+    // Library facilities used: vector
+    {own(); elements.push_back(value); adopt();}
+    template<class I> void append(I from, I to)
+    // Precondition: [from, to) is a range of elements not in *this
+    // Postcondition: the range is appended
+    // Library facilities used: vector
+    {own(); elements.insert(elements.end(), from, to); adopt();}
+    void swap(Array & other)
+    // Precondition: none
+    // Postcondition: the elements of *this and other are exchanged
+    // Library facilities used: vector
+    {
+      elements.swap(other.elements);
+      std::swap(first, other.first);
+      std::swap(count, other.count);
+    }
+    T & operator[](size_t index) {return first[index];}
+    T * begin() {return first;}
+    T * end() {return first + count;}
+
+    // CONSTANT MEMBER FUNCTIONS
+    const T & operator[](size_t index) const {return first[index];}
+    const T * begin() const {return first;}
+    const T * end() const {return first + count;}
+    size_t size() const {return count;}
+    bool empty() const {return count == 0;}
+    bool viewed() const {return count != 0 && elements.empty();}
+    // Precondition: none
+    // Postcondition: Return value is true if the elements are held
+    // elsewhere
+    bool operator==(const Array & rhs) const
+    {return count == rhs.count && std::equal(begin(), end(), rhs.begin());}
+
+  private:
+    void own()
+    // Precondition: none
+    // Postcondition: the elements are held in elements
+    {if(viewed()) elements.assign(first, first + count);}
+    void adopt()
+    // Precondition: none
+    // Postcondition: first and count describe elements
+    {first = elements.empty() ? NULL : &elements[0]; count = elements.size();}
+
+    // MEMBER VARIABLES
+    std::vector<T> elements;          // elements, if held by *this
+    T * first;                        // first element
+    size_t count;                     // number of elements
+  };
+}
+
+#endif
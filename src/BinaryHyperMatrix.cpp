@@ -0,0 +1,133 @@
+// FILE: BinaryHyperMatrix.cpp (part of namespace rlair_multi_clustering)
+// CLASS implemented: BinaryHyperMatrix (see BinaryHyperMatrix.h for documentation)
+
+#include <fstream>                  // provides: ofstream
+#include <cassert>                  // provides: assert
+#include "BinaryHyperMatrix.h"
+
+using namespace std;
+
+namespace rlair_multi_clustering
+{
+  const int BinaryHyperMatrix::BITS;
+
+  BinaryHyperMatrix::BinaryHyperMatrix() : rows(0), row_words(0) {}
+
+  BinaryHyperMatrix::BinaryHyperMatrix(const vector<int> & dimensions)
+    : dimensions(dimensions), rows(1), row_words(0)
+  // Library facilities used: none
+  {
+    int ways = int(dimensions.size());
+    if(ways == 0) return;
+    for(int way = 0; way != ways - 1; ++way) rows *= dimensions[way];
+    row_words = (dimensions[ways - 1] + BITS - 1) / BITS;
+    data = Array<word_t>(rows * row_words);
+  }
+
+  void BinaryHyperMatrix::set(const vector<int> & tuple, bool value)
+  // Library facilities used: assert
+  {
+    assert(tuple.size() == dimensions.size());
+    int unit = tuple.back();
+    word_t & word = data[row(tuple) * row_words + unit / BITS];
+    word_t bit = word_t(1) << (unit % BITS);
+    if(value) word |= bit;
+    else word &= ~bit;
+  }
+
+  void BinaryHyperMatrix::set_shared(const vector<int> & tuple, bool value)
+  // Library facilities used: assert, __sync_fetch_and_or, __sync_fetch_and_and
+  {
+    assert(tuple.size() == dimensions.size());
+    int unit = tuple.back();
+    word_t * word = &data[row(tuple) * row_words + unit / BITS];
+    word_t bit = word_t(1) << (unit % BITS);
+    if(value) __sync_fetch_and_or(word, bit);
+    else __sync_fetch_and_and(word, ~bit);
+  }
+
+  bool BinaryHyperMatrix::operator()(const vector<int> & tuple) const
+  // Library facilities used: assert
+  {
+    assert(tuple.size() == dimensions.size());
+    return test(row(tuple), tuple.back());
+  }
+
+  size_t BinaryHyperMatrix::row(const vector<int> & tuple) const
+  // Library facilities used: none
+  {
+    size_t index = 0;
+    for(size_t way = 0; way + 1 < dimensions.size(); ++way)
+      index = index * dimensions[way] + tuple[way];
+    return index;
+  }
+
+  void BinaryHyperMatrix::mask(const vector<int> & units, mask_t & mask) const
+  // Library facilities used: vector
+  {
+    vector<word_t> words(row_words);
+    for(size_t i = 0; i != units.size(); ++i)
+      words[units[i] / BITS] |= word_t(1) << (units[i] % BITS);
+    mask.clear();
+    for(size_t w = 0; w != row_words; ++w)
+      if(words[w]) mask.push_back(make_pair(w, words[w]));
+  }
+
+  int BinaryHyperMatrix::count(size_t row, const mask_t & mask) const
+  // Library facilities used: none
+  {
+    const word_t * words = &data[row * row_words];
+    int ones = 0;
+    for(size_t i = 0; i != mask.size(); ++i)
+      ones += popcount(words[mask[i].first] & mask[i].second);
+    return ones;
+  }
+
+  bool BinaryHyperMatrix::test(size_t row, int unit) const
+  // Library facilities used: none
+  {
+    return (data[row * row_words + unit / BITS] >> (unit % BITS)) & 1;
+  }
+
+  size_t BinaryHyperMatrix::bytes() const
+  // Library facilities used: none
+  {
+    return data.size() * sizeof(word_t);
+  }
+
+  void BinaryHyperMatrix::print_2D_slice
+  (const vector<int> & dimension, const string & file) const
+  // Library facilities used: ofstream
+  {
+    ofstream out(file.c_str());
+    print_2D_slice(dimension, out);
+    out.close();
+  }
+
+  void BinaryHyperMatrix::print_2D_slice
+  (const vector<int> & dimension, ostream & out) const
+  // Library facilities used: assert
+  {
+    int ways = static_cast<int>(dimensions.size());
+
+    assert(int(dimension.size()) == ways);
+
+    // get row and column ways
+    vector<int> plane;
+    for(int way = 0; way != ways; ++way)
+      if(dimension[way] == -1) plane.push_back(way);
+    assert(int(plane.size()) == 2);
+
+    const int ROW = plane[0];
+    const int COL = plane[1];
+
+    // print
+    vector<int> tuple(dimension);
+    for(tuple[ROW] = 0; tuple[ROW] != dimensions[ROW]; ++tuple[ROW])
+    {
+      for(tuple[COL] = 0; tuple[COL] != dimensions[COL]; ++tuple[COL])
+        out << operator()(tuple);
+      out << " " << endl;
+    }
+  }
+}
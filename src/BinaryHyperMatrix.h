@@ -0,0 +1,96 @@
+// FILE: BinaryHyperMatrix.h
+// CLASS PROVIDED: BinaryHyperMatrix (part of the namespace rlair_multi_clustering)
+
+#ifndef RLAIR_MULTI_CLUSTERING_BINARYHYPERMATRIX
+#define RLAIR_MULTI_CLUSTERING_BINARYHYPERMATRIX
+
+#include <iostream>                 // provides: ostream
+#include <string>                   // provides: string
+#include <vector>                   // provides: vector
+#include <utility>                  // provides: pair
+#include <cstddef>                  // provides: size_t
+#include <stdint.h>                 // provides: uint64_t
+#include "Array.h"
+
+namespace rlair_multi_clustering
+{
+  // Stores a binary hyper-matrix packed into 64-bit words. The last way is
+  // the bit direction: each row (a tuple of the other ways) starts on a word
+  // boundary, so the cells of a row that fall in a set of last-way units can
+  // be counted with popcount over a word mask.
+  class BinaryHyperMatrix
+  {
+  public:
+    typedef uint64_t word_t;
+    typedef std::vector<std::pair<size_t, word_t> > mask_t;
+
+    static const int BITS = 64;     // bits per word
+
+    // CONSTRUCTORS and DESTRUCTORS
+    BinaryHyperMatrix();
+    BinaryHyperMatrix(const std::vector<int> & dimensions);
+
+    // MODIFICATION MEMBER FUNCTIONS
+    void set(const std::vector<int> & tuple, bool value);
+    // Precondition: tuple is within range
+    // Postcondition: element located by tuple is value
+    void set_shared(const std::vector<int> & tuple, bool value);
+    // Precondition: tuple is within range
+    // Postcondition: same as set, but updates the word atomically so that
+    // threads may set distinct cells concurrently
+
+    // CONSTANT MEMBER FUNCTIONS
+    bool operator()(const std::vector<int> & tuple) const;
+    // Precondition: tuple is within range
+    // Postcondition: Return value is the element located by tuple
+    size_t row(const std::vector<int> & tuple) const;
+    // Precondition: tuple is within range (last way is ignored)
+    // Postcondition: Return value is the index of the row holding tuple
+    void mask(const std::vector<int> & units, mask_t & mask) const;
+    // Precondition: units are within range of the last way
+    // Postcondition: mask holds the nonzero words selecting units
+    int count(size_t row, const mask_t & mask) const;
+    // Precondition: row < rows
+    // Postcondition: Return value is number of ones of row selected by mask
+    bool test(size_t row, int unit) const;
+    // Precondition: row < rows, unit within range of the last way
+    // Postcondition: Return value is the element of row at unit
+    size_t bytes() const;
+    // Precondition: none
+    // Postcondition: Return value is the memory used by the elements
+    void print_2D_slice
+    (const std::vector<int> & dimension, const std::string & file) const;
+    void print_2D_slice
+    (const std::vector<int> & dimension, std::ostream & out) const;
+
+    // MEMBER VARIABLES
+    std::vector<int> dimensions;    // size of each way
+    size_t rows;                    // number of rows (product but last way)
+    size_t row_words;               // words per row
+    Array<word_t> data;             // packed rows
+  };
+
+  inline int popcount(BinaryHyperMatrix::word_t word)
+  // Precondition: none
+  // Postcondition: Return value is the number of bits set in word
+  // Library facilities used: none
+  {
+    if(sizeof(unsigned long) == sizeof(word))
+      return __builtin_popcountl((unsigned long)word);
+    return __builtin_popcount((unsigned)word) +
+      __builtin_popcount((unsigned)(word >> 32));
+  }
+
+  inline int lowest_bit(BinaryHyperMatrix::word_t word)
+  // Precondition: word != 0
+  // Postcondition: Return value is the index of the lowest bit set in word
+  // Library facilities used: none
+  {
+    if(sizeof(unsigned long) == sizeof(word))
+      return __builtin_ctzl((unsigned long)word);
+    if((unsigned)word != 0) return __builtin_ctz((unsigned)word);
+    return 32 + __builtin_ctz((unsigned)(word >> 32));
+  }
+}
+
+#endif
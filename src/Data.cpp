@@ -2,10 +2,18 @@
 // CLASS implemented: Data (see Data.h for documentation)
 
 #include <cstdlib>
-#include <cstring>
 #include <fstream>                  // provides: ifstream, ofstream
-#include <sstream>                  // provides: stringstream
 #include <cassert>                  // provides: assert
+#include <algorithm>                // provides: count, sort, find,
+                                    // lower_bound, adjacent_find
+#include <queue>                    // provides: priority_queue
+#include <functional>               // provides: greater
+#ifndef WIN32
+#include <fcntl.h>                  // provides: open
+#include <unistd.h>                 // provides: close
+#include <sys/mman.h>               // provides: mmap, munmap
+#include <sys/stat.h>               // provides: fstat
+#endif
 #include "Data.h"
 #include "Indexer.h"
 
@@ -13,105 +21,429 @@ using namespace std;
 
 namespace rlair_multi_clustering
 {
-  Data::Data() {}
+  Data::Data() : values(0), bytes(0), storage(DENSE),
+    layout(HyperMatrix<T>::ROW_MAJOR), cache(true), cached(false), budget(0),
+    mapped(NULL), mapped_size(0) {}
 
   Data::Data(const string dir, const string data_file, const string labels_file)
-    : dir(dir), data_file(data_file), labels_file(labels_file) {}
+    : values(0), bytes(0), storage(DENSE), layout(HyperMatrix<T>::ROW_MAJOR),
+      cache(true), cached(false), budget(0), dir(dir), data_file(data_file),
+      labels_file(labels_file), mapped(NULL), mapped_size(0) {}
 
-  void Data::load()
-  // Library facilities used: fstream, stringstream
+  Data::Data(const Data & source)
+    : values(0), bytes(0), storage(DENSE), layout(HyperMatrix<T>::ROW_MAJOR),
+      cache(true), cached(false), budget(0), dir(source.dir),
+      data_file(source.data_file),
+      labels_file(source.labels_file), mapped(NULL), mapped_size(0)
+  // Library facilities used: none
+  {
+    *this = source;
+  }
+
+  Data::~Data()
+  // Library facilities used: none
   {
-	  // Open data file
-    ifstream in;
+    unmap_cache();
+  }
+
+  void Data::load(int threads, ThreadPool & pool)
+  // Library facilities used: fstream, map_file, parse_int, ThreadPool, sort,
+  // find
+  {
+    // Read binary cache of previous load
+    unmap_cache();
+    cached = cache && storage != TILED && load_cache();
+    if(cached) return;
+
+    // Map data file
+    size_t size = 0;
     string pathname = string(dir + data_file);
-	  in.open(pathname.c_str());
-	  if(in.fail()) {cerr << "error opening " << pathname << endl; exit(1);}
-
-    // Get modes, dimensions, ways, way-mode map, values
-    char line[LENGTH];
-    in.getline(line, LENGTH);
-    stringstream token(line);
-    int modes; token >> modes;
-    vector<int> dimension(modes, -1);
-    for(int i = 0; i != modes; ++i) token >> dimension[i];
-    int ways; token >> ways;
-    vector<int> way_mode(ways, -1);
-    for(int i = 0; i != ways; ++i) token >> way_mode[i];
-    token >> values;
+    const char * file = map_file(pathname, size);
+    if(file == NULL) {cerr << "error opening " << pathname << endl; exit(1);}
+    const char * p = file;
+    const char * end = file + size;
+    bytes = size;
+
+    // Get modes, dimensions, ways, way-mode map, values (first line)
+    int modes = 0;
+    bool valid = parse_int(p, end, modes) && modes > 0;
+    vector<int> dimension(valid ? modes : 0, -1);
+    for(int i = 0; valid && i != modes; ++i)
+      valid = parse_int(p, end, dimension[i]) && dimension[i] > 0;
+    int ways = 0;
+    valid = valid && parse_int(p, end, ways) && ways > 0;
+    vector<int> way_mode(valid ? ways : 0, -1);
+    for(int i = 0; valid && i != ways; ++i)
+      valid = parse_int(p, end, way_mode[i]) &&
+        way_mode[i] >= 0 && way_mode[i] < modes;
+    valid = valid && parse_int(p, end, values) && values > 0;
+    if(!valid || !parse_end_of_line(p, end))
+      parse_error(pathname, file, p, "malformed header");
+    mode_dimensions = dimension;
+    way_modes = way_mode;
 
     // Initialize matrix
     vector<int> dimensions(ways);
     for(int i = 0; i != ways; ++i) dimensions[i] = dimension[way_mode[i]];
-    matrix = HyperMatrix<T>(dimensions);
+    if(storage == DENSE && values == 2 && layout == HyperMatrix<T>::ROW_MAJOR)
+      storage = BINARY;
+    if(storage == SPARSE) sparse = SparseHyperMatrix<T>(dimensions);
+    else if(storage == BINARY) binary = BinaryHyperMatrix(dimensions);
+    else if(storage == TILED)
+      tiled = TiledHyperMatrix(dimensions, values == 2,
+        scratch.empty() ? dir : scratch, budget);
+    else matrix = HyperMatrix<T>(dimensions, layout);
 
-    // Get data
-    in.getline(line, LENGTH);
-    while(!in.eof())
+    // Get data in newline-aligned chunks parsed in parallel (tiles are
+    // staged in file order by one thread)
+    int chunks = threads < 1 ? 1 : threads;
+    if(size_t(end - p) / chunks < CHUNK) chunks = int((end - p) / CHUNK) + 1;
+    if(storage == TILED) chunks = 1;
+    vector<Chunk> parts(chunks);
+    bool record = chunks > 1 && (storage == DENSE || storage == BINARY);
+    for(int i = 0; i != chunks; ++i)
     {
-      stringstream token(line);
-      vector<int> tuple(ways);
-      for(int way = 0; way != ways; ++way) token >> tuple[way];
-      T value; token >> value;
-      matrix[hyper_index(tuple, dimensions)] = value == 0 ? 0 : 1;
-      in.getline(line, LENGTH);
+      parts[i].data = this;
+      parts[i].error = NULL;
+      parts[i].reason = NULL;
+      parts[i].record = record;
+      parts[i].begin = i == 0 ? p : parts[i - 1].end;
+      parts[i].end = i == chunks - 1 ? end : p + (end - p) / chunks * (i + 1);
+      if(parts[i].end < parts[i].begin) parts[i].end = parts[i].begin;
+      while(parts[i].end != end && parts[i].end[-1] != '\n') ++parts[i].end;
+      if(storage == SPARSE) parts[i].part = SparseHyperMatrix<T>(dimensions);
     }
+    pool.run(chunks, parse_chunk, &parts[0], chunks);
+
+    // Report the first malformed line in file order
+    for(int i = 0; i != chunks; ++i)
+      if(parts[i].error != NULL)
+        parse_error(pathname, file, parts[i].error, parts[i].reason);
 
-    // Close data file
-	  in.close();
-
-    // Open labels file
-    in.clear();
-    pathname = string(dir + labels_file);
-	  in.open(pathname.c_str());
-	  if(in.fail()) {cerr << "error opening " << pathname << endl; exit(1);}
-
-    // Read in labels
-	  cout << endl; // TEST REMOVE
-    int way = 0;
-    int count = 0;
-    labels = labels_t(ways);
-    in.getline(line, LENGTH);
-    while(!in.eof())
+    // Set the cells set by several chunks again from their last line, in
+    // file order (the sorted lines of the chunks are merged over ranges of
+    // cells in parallel)
+    if(record)
     {
-      cout << strcmp(line, "") << endl;//TEST REMOVE
-      if(strcmp(line, ""))
+      index_t cells = 1;
+      for(int i = 0; i != ways; ++i) cells *= dimensions[i];
+      vector<Merge> merges(chunks);
+      for(int i = 0; i != chunks; ++i)
       {
-        //for(int way = 0; way != ways; ++way)
-          //if(way_mode[way] == mode) labels[way].push_back(string(line));
-        labels[way].push_back(string(line));
-        ++count;
+        merges[i].parts = &parts;
+        merges[i].begin = cells / chunks * i;
+        merges[i].end = i == chunks - 1 ? cells : cells / chunks * (i + 1);
+      }
+      pool.run(chunks, merge_lines, &merges[0], chunks);
+      vector<const char *> last;
+      for(int i = 0; i != chunks; ++i)
+      {
+        last.insert(last.end(), merges[i].last.begin(), merges[i].last.end());
+        vector<line_t>().swap(parts[i].lines);
+      }
+      sort(last.begin(), last.end());
+      Chunk replay;
+      replay.data = this;
+      replay.error = NULL;
+      replay.reason = NULL;
+      replay.record = false;
+      for(size_t i = 0; i != last.size(); ++i)
+      {
+        replay.begin = last[i];
+        replay.end = find(last[i], end, '\n');
+        if(replay.end != end) ++replay.end;
+        parse(replay);
       }
-      else {count = 0; ++way;}
-      in.getline(line, LENGTH);
     }
 
-    // check
-    for(way = 0; way != ways; ++way) {
-      cout << labels[way].size() << " = " << dimension[way] << endl;//TEST REMOVE
-      assert(int(labels[way].size()) == dimension[way]);
+    // Gather nonzeros of sparse chunks in file order
+    if(storage == SPARSE)
+    {
+      for(int i = 0; i != chunks; ++i) sparse.append(parts[i].part);
+      sparse.compress();
     }
 
-    // close file
-    in.close();
+    // Write the tuples still staged to their tiles
+    if(storage == TILED) tiled.apply();
+
+    // Unmap data file
+    unmap_file(file, size);
+
+    // Labels are read when first needed
+    labels.open(dir + labels_file, dimensions);
+  }
+
+  void Data::update(const vector<update_t> & batch)
+  // Library facilities used: none
+  {
+    for(size_t i = 0; i != batch.size(); ++i)
+    {
+      const vector<int> & tuple = batch[i].tuple;
+      T value = batch[i].value == 0 ? 0 : 1;
+      if(storage == SPARSE) sparse.set(tuple, value);
+      else if(storage == BINARY) binary.set(tuple, value != 0);
+      else if(storage == TILED)
+        tiled.set(tuple, TiledHyperMatrix::cell_t(value));
+      else matrix(tuple) = value;
+    }
+  }
+
+  void Data::parse(Chunk & chunk)
+  // Library facilities used: parse_int, parse_end_of_line
+  {
+    // one tuple of way indexes followed by the value per line (blank lines
+    // are skipped)
+    const vector<int> & dimensions = this->dimensions();
+    int ways = this->ways();
+    vector<int> tuple(ways);
+    T value;
+    const char * p = chunk.begin;
+    const char * end = chunk.end;
+    while(p != end)
+    {
+      const char * line = p;
+      if(parse_end_of_line(p, end)) continue;
+      int way = 0;
+      while(way != ways && parse_int(p, end, tuple[way])) ++way;
+      if(way != ways || !parse_int(p, end, value))
+      {
+        chunk.error = line;
+        chunk.reason = "expected one integer per way and a value";
+        return;
+      }
+      if(!parse_end_of_line(p, end))
+      {
+        chunk.error = line;
+        chunk.reason = "unexpected characters after the value";
+        return;
+      }
+      for(way = 0; way != ways; ++way)
+        if(tuple[way] < 0 || tuple[way] >= dimensions[way])
+        {
+          chunk.error = line;
+          chunk.reason = "coordinate out of range";
+          return;
+        }
+      if(chunk.record)
+        chunk.lines.push_back(line_t(hyper_index(tuple, dimensions), line));
+      if(storage == SPARSE) chunk.part.insert(tuple, value == 0 ? 0 : 1);
+      else if(storage == TILED)
+        tiled.stage(tuple, TiledHyperMatrix::cell_t(value == 0 ? 0 : 1));
+      else if(storage == BINARY) binary.set_shared(tuple, value != 0);
+      else matrix(tuple) = value == 0 ? 0 : 1;
+    }
+  }
+
+  void parse_chunk(void * chunks, int chunk)
+  // Library facilities used: adjacent_find, greater, sort
+  {
+    Data::Chunk & part = static_cast<Data::Chunk *>(chunks)[chunk];
+    part.data->parse(part);
+
+    // lines of a tuple list in cell order are sorted already
+    if(adjacent_find(part.lines.begin(), part.lines.end(),
+      greater<Data::line_t>()) != part.lines.end())
+      sort(part.lines.begin(), part.lines.end());
+  }
+
+  inline bool before_cell(const Data::line_t & line, index_t cell)
+  // Precondition: none
+  // Postcondition: Return value is true if line sets a cell before cell
+  // Library facilities used: none
+  {return line.first < cell;}
+
+  void merge_lines(void * merges, int merge)
+  // Library facilities used: lower_bound, priority_queue, greater
+  {
+    Data::Merge & range = static_cast<Data::Merge *>(merges)[merge];
+    const vector<Data::Chunk> & parts = *range.parts;
+    int chunks = int(parts.size());
+
+    // lines of the range in each chunk, merged by cell and line
+    typedef pair<Data::line_t, int> head_t;
+    priority_queue<head_t, vector<head_t>, greater<head_t> > heads;
+    vector<size_t> next(chunks);
+    vector<size_t> stop(chunks);
+    for(int i = 0; i != chunks; ++i)
+    {
+      const vector<Data::line_t> & lines = parts[i].lines;
+      next[i] = lower_bound(lines.begin(), lines.end(), range.begin,
+        before_cell) - lines.begin();
+      stop[i] = lower_bound(lines.begin(), lines.end(), range.end,
+        before_cell) - lines.begin();
+      if(next[i] != stop[i]) heads.push(head_t(lines[next[i]], i));
+    }
+
+    // last line of each cell, if set by several chunks (the lines of a
+    // chunk before the next cell of the others are skipped, and none are
+    // left to merge once the lines of a single chunk are left)
+    while(heads.size() > 1)
+    {
+      index_t cell = heads.top().first.first;
+      int first = heads.top().second;
+      const char * line = NULL;
+      bool shared = false;
+      while(!heads.empty() && heads.top().first.first == cell)
+      {
+        int i = heads.top().second;
+        line = heads.top().first.second;
+        shared = shared || i != first;
+        heads.pop();
+        const vector<Data::line_t> & lines = parts[i].lines;
+        index_t floor = heads.empty() ? cell : heads.top().first.first;
+        if(++next[i] != stop[i] && lines[next[i]].first < floor)
+          next[i] = lower_bound(lines.begin() + next[i],
+            lines.begin() + stop[i], floor, before_cell) - lines.begin();
+        if(next[i] != stop[i]) heads.push(head_t(lines[next[i]], i));
+      }
+      if(shared) range.last.push_back(line);
+    }
   }
 
   void Data::operator =(const Data& source)
   // Library facilities used: none
   {
     values = source.values;
+    bytes = source.bytes;
+    storage = source.storage;
+    layout = source.layout;
+    cache = source.cache;
+    cached = source.cached;
+    budget = source.budget;
+    scratch = source.scratch;
+    mode_dimensions = source.mode_dimensions;
+    way_modes = source.way_modes;
     labels = source.labels;
     matrix = source.matrix;
+    sparse = source.sparse;
+    binary = source.binary;
+    tiled = source.tiled;
+
+    // the matrices now hold copies
+    if(&source != this)
+    {
+      unmap_file(mapped, mapped_size);
+      mapped = NULL;
+      mapped_size = 0;
+    }
+  }
+
+  void Data::make_dense(HyperMatrix<T>::layout_t layout)
+  // Library facilities used: Indexer
+  {
+    Indexer::dimensions_t dimensions = this->dimensions();
+    Indexer::mask_t mask(dimensions.size());
+    HyperMatrix<T> dense(dimensions, layout);
+    for(Indexer indexer(dimensions, mask); !indexer.end(); indexer.forward())
+      dense(indexer.get_tuple()) = get(indexer.get_tuple());
+    matrix = dense;
+    sparse = SparseHyperMatrix<T>();
+    binary = BinaryHyperMatrix();
+    tiled = TiledHyperMatrix();
+    storage = DENSE;
+    this->layout = layout;
   }
 
-  std::vector<int> Data::dimensions() const
+  const std::vector<int> & Data::dimensions() const
   // Library facilities used: none
   {
+    if(storage == SPARSE) return sparse.dimensions;
+    if(storage == BINARY) return binary.dimensions;
+    if(storage == TILED) return tiled.dimensions;
     return matrix.dimensions;
   }
 
   int Data::ways() const
   // Library facilities used: none
   {
-    return static_cast<int>(matrix.dimensions.size());
+    return static_cast<int>(dimensions().size());
+  }
+
+  Data::T Data::get(const std::vector<int> & tuple) const
+  // Library facilities used: none
+  {
+    if(storage == SPARSE) return sparse(tuple);
+    if(storage == BINARY) return binary(tuple) ? 1 : 0;
+    if(storage == TILED) return tiled(tuple);
+    return matrix(tuple);
+  }
+
+  size_t Data::memory() const
+  // Library facilities used: none
+  {
+    if(storage == SPARSE) return sparse.bytes();
+    if(storage == BINARY) return binary.bytes();
+    if(storage == TILED) return tiled.bytes();
+    return matrix.size() * sizeof(T);
+  }
+
+  void Data::print_2D_slice
+  (const std::vector<int> & dimension, const std::string & file) const
+  // Library facilities used: none
+  {
+    if(storage == SPARSE) sparse.print_2D_slice(dimension, file);
+    else if(storage == BINARY) binary.print_2D_slice(dimension, file);
+    else if(storage == TILED) tiled.print_2D_slice(dimension, file);
+    else matrix.print_2D_slice(dimension, file);
+  }
+
+  void Data::print_2D_slice
+  (const std::vector<int> & dimension, std::ostream & out) const
+  // Library facilities used: none
+  {
+    if(storage == SPARSE) sparse.print_2D_slice(dimension, out);
+    else if(storage == BINARY) binary.print_2D_slice(dimension, out);
+    else if(storage == TILED) tiled.print_2D_slice(dimension, out);
+    else matrix.print_2D_slice(dimension, out);
+  }
+
+  const char * map_file(const string & pathname, size_t & size,
+    bool writable)
+  // Library facilities used: mmap (ifstream on WIN32)
+  {
+    size = 0;
+#ifndef WIN32
+    int fd = open(pathname.c_str(), O_RDONLY);
+    if(fd == -1) return NULL;
+    struct stat status;
+    if(fstat(fd, &status) == -1) {close(fd); return NULL;}
+    size = size_t(status.st_size);
+    if(size == 0) {close(fd); return "";}
+    void * file = mmap(NULL, size,
+      writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(file == MAP_FAILED) {size = 0; return NULL;}
+    madvise(file, size, MADV_SEQUENTIAL);
+    return static_cast<const char *>(file);
+#else
+    ifstream in(pathname.c_str(), ios::in | ios::binary);
+    if(in.fail()) return NULL;
+    in.seekg(0, ios::end);
+    size = size_t(in.tellg());
+    in.seekg(0, ios::beg);
+    char * file = new char[size + 1];
+    in.read(file, size);
+    return file;
+#endif
+  }
+
+  void parse_error(const string & pathname, const char * file,
+    const char * at, const char * reason)
+  // Library facilities used: count, exit
+  {
+    cerr << "error: " << pathname << " line "
+      << count(file, at, '\n') + 1 << ": " << reason << endl;
+    exit(1);
+  }
+
+  void unmap_file(const char * file, size_t size)
+  // Library facilities used: munmap (delete on WIN32)
+  {
+    if(file == NULL || size == 0) return;
+#ifndef WIN32
+    munmap(const_cast<char *>(file), size);
+#else
+    delete [] file;
+#endif
   }
 }
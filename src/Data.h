@@ -5,10 +5,20 @@
 #define RLAIR_MULTI_CLUSTERING_DATA
 
 #define LENGTH 256
+#define CHUNK (1 << 20)             // minimum bytes parsed per thread
 
 #include <iostream>                 // provides: ostream
 #include <string>                   // provides: string
+#include <cstddef>                  // provides: size_t
+#include <climits>                  // provides: INT_MAX
+#include <stdint.h>                 // provides: int64_t
+#include <utility>                  // provides: pair
 #include "HyperMatrix.h"
+#include "SparseHyperMatrix.h"
+#include "BinaryHyperMatrix.h"
+#include "TiledHyperMatrix.h"
+#include "Labels.h"
+#include "ThreadPool.h"
 
 namespace rlair_multi_clustering
 {
@@ -16,38 +26,220 @@ namespace rlair_multi_clustering
   {
   public:
     typedef int T;
-    typedef std::vector<std::vector<std::string> > labels_t;
+    enum storage_t {DENSE, SPARSE, BINARY, TILED};
+
+    // new value of a cell (value 0 removes a nonzero tuple)
+    struct update_t
+    {
+      std::vector<int> tuple;
+      T value;
+    };
 
     // CONSTRUCTORS and DESTRUCTOR
     Data();
     Data(const std::string dir, const std::string data_file, const std::string labels_file);
+    Data(const Data & source);
+    ~Data();
 
     // MODIFICATION MEMBER FUNCTIONS
-    void load();
-    // Precondition: none
-    // Postcondition: matrix and labels have data from files
+    void load(int threads, ThreadPool & pool);
+    // Precondition: threads > 0
+    // Postcondition: matrix has data from files and labels will be read
+    // from file when first used; DENSE storage of a binary matrix
+    // (values == 2) is switched to BINARY unless layout is BLOCKED, and
+    // DENSE cells are stored in layout. If cache is set, they are read
+    // from the binary cache next to the data file when it matches the input
+    // files (cached is set; otherwise see save_cache), the matrix then
+    // viewing the cache file in place until it changes size. TILED storage
+    // keeps the matrix in a temporary tile file in scratch (the input
+    // directory if scratch is empty), rebuilt on every load by one thread
+    // through a buffer of at most budget bytes and removed when no longer
+    // used; the cache is not used. The tuple list is split into one chunk
+    // per thread (at most threads), parsed on pool. A malformed line (not
+    // exactly ways + 1 integers, or a coordinate out of range) is reported
+    // with its line number and the program exits. A cell listed more than once takes
+    // the value of its last line, as if parsed in file order (DENSE and
+    // BINARY chunks list the cell and line of each tuple they set, and the
+    // last line of each cell set by several chunks is parsed again, in file
+    // order, after the chunks join).
+    void update(const std::vector<update_t> & batch);
+    // Precondition: tuples of batch are within range
+    // Postcondition: cells of batch have their new value (collapsed to 0/1
+    // as in load); later updates of a cell override earlier ones. The cost
+    // is proportional to the batch (SPARSE cells are set in place or
+    // appended, and compressed again only once enough are appended)
+    void make_dense(HyperMatrix<T>::layout_t layout);
+    // Precondition: *this has been loaded
+    // Postcondition: storage is DENSE with the cells stored in layout (a
+    // copy of those of the previous storage, which is released)
     void operator =(const Data & source);
     // Precondition: none
     // Postcondition: *this == source
 
     // CONSTANT MEMBER FUNCTIONS
-    std::vector<int> dimensions() const;
+    const std::vector<int> & dimensions() const;
     // Precondition: none
     // Postcondition: Return value is vector of way lengths
     int ways() const;
     // Precondition: none
     // Postcondition: Return value is number of matrix ways
+    T get(const std::vector<int> & tuple) const;
+    // Precondition: tuple is within range
+    // Postcondition: Return value is the element located by tuple
+    size_t memory() const;
+    // Precondition: none
+    // Postcondition: Return value is number of bytes used by matrix storage
+    void save_cache() const;
+    // Precondition: *this has been loaded from the input files (not cached)
+    // and storage is not TILED
+    // Postcondition: cache holds the header, matrix and labels of *this
+    void print_2D_slice
+    (const std::vector<int> & dimension, const std::string & file) const;
+    void print_2D_slice
+    (const std::vector<int> & dimension, std::ostream & out) const;
 
     // MEMBER VARIABLES
     int values;                       // number distinct values
-    labels_t labels;                  // labels for each way unit
-    HyperMatrix<T> matrix;            // data matrix
+    size_t bytes;                     // size of input files loaded
+    storage_t storage;                // matrix storage backend
+    HyperMatrix<T>::layout_t layout;  // order of the cells (DENSE)
+    bool cache;                       // use binary cache of input files
+    bool cached;                      // input was read from cache
+    size_t budget;                    // bytes of resident tiles (TILED)
+    std::string scratch;              // directory of the tile file (TILED)
+    Labels labels;                    // labels for each way unit
+    HyperMatrix<T> matrix;            // data matrix (DENSE)
+    SparseHyperMatrix<T> sparse;      // nonzero tuples (SPARSE)
+    BinaryHyperMatrix binary;         // bit-packed matrix (BINARY)
+    TiledHyperMatrix tiled;           // out-of-core matrix (TILED)
+
+    // flat index of a cell and the line of the tuple that sets it
+    typedef std::pair<index_t, const char *> line_t;
+
+    // chunk of the tuple list parsed by one thread
+    struct Chunk
+    {
+      Data * data;
+      const char * begin;
+      const char * end;
+      SparseHyperMatrix<T> part;      // tuples of chunk (SPARSE)
+      const char * error;             // first malformed line, or NULL
+      const char * reason;            // what is wrong with it
+      bool record;                    // list the tuples set in lines
+      std::vector<line_t> lines;      // tuples set, sorted by cell and line
+                                      // once parsed (if record)
+    };
+
+    // range of cells whose lines are merged over the chunks by one thread
+    struct Merge
+    {
+      const std::vector<Chunk> * parts;
+      index_t begin;                  // first cell
+      index_t end;                    // past last cell
+      std::vector<const char *> last; // last line of each cell set by
+                                      // several chunks
+    };
 
   private:
+    friend void parse_chunk(void * chunks, int chunk);
+
     const std::string dir;
     const std::string data_file;
     const std::string labels_file;
+    std::vector<int> mode_dimensions; // size of each mode
+    std::vector<int> way_modes;       // mode of each way
+    const char * mapped;              // cache file viewed by the matrix, or
+                                      // NULL
+    size_t mapped_size;               // bytes of mapped
+
+    // UTILITY MEMBER FUNCTIONS
+    void parse(Chunk & chunk);
+    // Precondition: matrix is initialized, chunk holds whole tuple lines
+    // Postcondition: tuples are set in matrix (appended to chunk.part if
+    // storage is SPARSE, staged if TILED) up to the first malformed line,
+    // which is recorded in chunk.error; if chunk.record, the cell and line
+    // of each tuple are listed in chunk.lines; safe to run concurrently on
+    // disjoint chunks (a cell set by several is set again afterwards)
+    std::string cache_pathname() const;
+    // Precondition: none
+    // Postcondition: Return value is pathname of the cache of the input
+    bool load_cache();
+    // Precondition: none
+    // Postcondition: if the cache exists, is intact and was built from the
+    // current input files with compatible storage, *this has its contents
+    // (the matrix payload viewed in the cache file, mapped copy-on-write)
+    // and Return value is true
+    void unmap_cache();
+    // Precondition: none
+    // Postcondition: no matrix views the cache file, which is unmapped
   };
+
+  void parse_chunk(void * chunks, int chunk);
+  // Precondition: chunks points to an array of Data::Chunk
+  // Postcondition: tuples of chunk are parsed and its lines are sorted
+  // (task of the thread pool)
+  void merge_lines(void * merges, int merge);
+  // Precondition: merges points to an array of Data::Merge, whose chunks
+  // have been parsed
+  // Postcondition: the last lines of the cells of the range of merge that
+  // are set by several chunks are listed in its last (task of the thread
+  // pool)
+  const char * map_file(const std::string & pathname, size_t & size,
+    bool writable = false);
+  // Precondition: pathname names a readable file
+  // Postcondition: Return value is the file contents mapped read-only into
+  // memory (copy-on-write if writable: the pages may be written without
+  // changing the file) and size is its length in bytes, or NULL if it
+  // cannot be opened
+  void unmap_file(const char * file, size_t size);
+  // Precondition: file and size were returned by map_file
+  // Postcondition: file is no longer mapped
+  void parse_error(const std::string & pathname, const char * file,
+    const char * at, const char * reason);
+  // Precondition: at points into file, the contents of pathname
+  // Postcondition: the line number of at and reason are reported and the
+  // program exits
+
+  inline bool is_blank(char c)
+  // Precondition: none
+  // Postcondition: Return value is true if c separates the fields of a line
+  // Library facilities used: none
+  {return c == ' ' || c == '\t' || c == '\r';}
+
+  inline bool parse_int(const char * & p, const char * end, int & value)
+  // Precondition: [p, end) is a range of characters
+  // Postcondition: blanks are skipped; if an integer within the range of
+  // int follows, value is that integer, p points past it and Return value
+  // is true. Otherwise (end of line or range, or another character) p
+  // points at it and Return value is false.
+  // Library facilities used: INT_MAX
+  {
+    while(p != end && is_blank(*p)) ++p;
+    const char * q = p;
+    bool negative = q != end && *q == '-';
+    if(negative) ++q;
+    if(q == end || *q < '0' || *q > '9') return false;
+    int64_t number = 0;
+    while(q != end && *q >= '0' && *q <= '9')
+      if((number = 10 * number + (*q++ - '0')) > INT_MAX) return false;
+    value = int(negative ? -number : number);
+    p = q;
+    return true;
+  }
+
+  inline bool parse_end_of_line(const char * & p, const char * end)
+  // Precondition: [p, end) is a range of characters
+  // Postcondition: blanks are skipped; if the line ends there (newline or
+  // end of range) p points past it and Return value is true, otherwise p
+  // points at the first other character and Return value is false
+  // Library facilities used: none
+  {
+    while(p != end && is_blank(*p)) ++p;
+    if(p == end) return true;
+    if(*p != '\n') return false;
+    ++p;
+    return true;
+  }
 }
 
 #endif
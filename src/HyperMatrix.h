@@ -8,29 +8,79 @@
 #include <string>                   // provides: string
 #include <vector>                   // provides: vector
 #include "Indexer.h"
+#include "Array.h"
 
 namespace rlair_multi_clustering
 {
+  // View of the cells of a hyper-matrix in which some ways are fixed: the
+  // free ways keep the positions of their units, so cells are located
+  // without copying whatever the layout of the matrix
+  template<class T>
+  class HyperSlice
+  {
+  public:
+    HyperSlice(T * origin, const std::vector<int> & dimensions,
+      const std::vector<std::vector<index_t> > & positions)
+    : dimensions(dimensions), positions(positions), origin(origin) {}
+
+    T & operator()(int row, int column) const
+    // Precondition: slice has two ways, row and column are within range
+    // Postcondition: Return value is the element at row and column
+    // Library facilities used: assert
+    {
+      assert(dimensions.size() == 2);
+      return origin[positions[0][row] + positions[1][column]];
+    }
+
+    T & operator()(const std::vector<int> & tuple) const
+    // Precondition: tuple is within range of the free ways
+    // Postcondition: Return value is the element located by tuple
+    // Library facilities used: assert
+    {
+      assert(tuple.size() == dimensions.size());
+      index_t offset = 0;
+      for(size_t way = 0; way != tuple.size(); ++way)
+        offset += positions[way][tuple[way]];
+      return origin[offset];
+    }
+
+    // MEMBER VARIABLES
+    std::vector<int> dimensions;      // size of each free way
+    std::vector<std::vector<index_t> > positions; // offset of each unit of
+                                      // each free way
+    T * origin;                       // cell with free ways at zero
+  };
+
+  // Stores the cells of a hyper-matrix in one of two layouts. ROW_MAJOR is
+  // the flat order (last way fastest). BLOCKED splits the matrix into tiles
+  // of the same number of units along every way (a power of two, so that a
+  // tile has at most TILE_CELLS cells: 64 x 64, 16 x 16 x 16, ...), stored
+  // tile after tile in flat order of the tiles, the cells of each tile in
+  // flat order; cells close along any way are then close in memory, and
+  // TileWalker visits them in that order. Both layouts are additive per
+  // way: the offset of a cell is the sum of the positions of its units.
   template<class T>
   class HyperMatrix
   {
   public:
     friend class Data;
 
+    enum layout_t {ROW_MAJOR, BLOCKED};
+
+    static const index_t TILE_CELLS = 4096; // most cells of a tile (BLOCKED)
+
     // CONSTRUCTORS and DESTRUCTORS
-    HyperMatrix() {}
+    HyperMatrix() : layout(ROW_MAJOR) {}
 
     HyperMatrix(const HyperMatrix & source)
-    : data(source.data), dimensions(source.dimensions) {}
+    : data(source.data), dimensions(source.dimensions),
+      layout(source.layout), spans(source.spans),
+      positions(source.positions) {}
 
-    HyperMatrix(const std::vector<int> & dimensions)
-    : dimensions(dimensions)
+    HyperMatrix(const std::vector<int> & dimensions,
+      layout_t layout = ROW_MAJOR)
     // Library facilities used: none
-    {
-      size_t size = 1;
-      for(size_t i = 0; i != dimensions.size(); ++i) size *= dimensions[i];
-      data = std::vector<T>(size);
-    }
+    {reshape(dimensions, layout);}
 
     // MODIFICATION MEMBER FUNCTIONS
     HyperMatrix & operator=(const HyperMatrix & source)
@@ -40,24 +90,92 @@ namespace rlair_multi_clustering
     {
       data = source.data;
       dimensions = source.dimensions;
+      layout = source.layout;
+      spans = source.spans;
+      positions = source.positions;
       return *this;
     }
 
-    T & operator[](int index)
+    void reshape(const std::vector<int> & dimensions,
+      layout_t layout = ROW_MAJOR)
+    // Precondition: none
+    // Postcondition: matrix has the given dimensions and layout, spans and
+    // positions are those of the layout, and data has one element (zero if
+    // new) per stored cell (BLOCKED pads the last tile along each way)
+    // Library facilities used: none
+    {
+      int ways = int(dimensions.size());
+      this->dimensions = dimensions;
+      this->layout = layout;
+
+      // units of a tile along each way (a single tile if ROW_MAJOR)
+      spans = dimensions;
+      if(layout == BLOCKED)
+      {
+        int edge = 1;
+        for(;;)
+        {
+          index_t cells = 1;
+          for(int way = 0; way != ways; ++way) cells *= 2 * edge;
+          if(ways == 0 || cells > TILE_CELLS) break;
+          edge *= 2;
+        }
+        spans.assign(ways, edge);
+      }
+
+      // position of a unit: offset of its tile plus its offset in the tile
+      index_t tile = 1;
+      for(int way = 0; way != ways; ++way) tile *= spans[way];
+      positions = std::vector<std::vector<index_t> >(ways);
+      index_t tiles = 1;
+      index_t inner = 1;
+      for(int way = ways - 1; way >= 0; --way)
+      {
+        int span = spans[way] > 0 ? spans[way] : 1;
+        positions[way].resize(dimensions[way]);
+        for(int unit = 0; unit != dimensions[way]; ++unit)
+          positions[way][unit] =
+            (unit / span) * tiles * tile + (unit % span) * inner;
+        tiles *= (dimensions[way] + span - 1) / span;
+        inner *= span;
+      }
+      data.resize(size_t(tiles * tile));
+    }
+
+    T & operator()(const std::vector<int> & tuple)
+    // Precondition: tuple is within range
+    // Postcondition: Return value is the element located by tuple
+    // Library facilities used: none
+    {return data[size_t(offset(tuple))];}
+
+    HyperSlice<T> slice(const std::vector<int> & dimension)
+    // Precondition: dimension is -1 at the free ways and the unit of the
+    // others
+    // Postcondition: Return value views the cells with the fixed ways at
+    // their units
+    // Library facilities used: none
+    {
+      std::vector<int> sizes;
+      std::vector<std::vector<index_t> > steps;
+      index_t origin = slice(dimension, sizes, steps);
+      return HyperSlice<T>(&data[0] + origin, sizes, steps);
+    }
+
+    T & operator[](index_t index)
     // Precondition: index is within range
-    // Postcondition: Return value is the element located by flat index
+    // Postcondition: Return value is the element at offset index of data
     // Library facilities used: none
     {
-      assert(index < static_cast<int>(data.size()));
+      assert(index >= 0 && size_t(index) < data.size());
       return data[index];
     }
 
-    T operator[](int index) const
+    T operator[](index_t index) const
     // Precondition: index is within range
-    // Postcondition: Return value is the element located by flat index
+    // Postcondition: Return value is the element at offset index of data
     // Library facilities used: none
     {
-      assert(index < static_cast<int>(data.size()));
+      assert(index >= 0 && size_t(index) < data.size());
       return data[index];
     }
 
@@ -65,11 +183,46 @@ namespace rlair_multi_clustering
     size_t size() const {return data.size();}
     // Precondition: none
     // Postcondition: The return value is the number of elements in matrix
+    // (stored cells, padding included)
+
+    index_t offset(const std::vector<int> & tuple) const
+    // Precondition: tuple is within range
+    // Postcondition: Return value is the offset of tuple in data
+    // Library facilities used: assert
+    {
+      assert(tuple.size() == dimensions.size());
+      index_t index = 0;
+      for(size_t way = 0; way != tuple.size(); ++way)
+        index += positions[way][tuple[way]];
+      return index;
+    }
+
+    T operator()(const std::vector<int> & tuple) const
+    // Precondition: tuple is within range
+    // Postcondition: Return value is the element located by tuple
+    // Library facilities used: none
+    {return data[size_t(offset(tuple))];}
+
+    HyperSlice<const T> slice(const std::vector<int> & dimension) const
+    // Precondition: dimension is -1 at the free ways and the unit of the
+    // others
+    // Postcondition: Return value views the cells with the fixed ways at
+    // their units
+    // Library facilities used: none
+    {
+      std::vector<int> sizes;
+      std::vector<std::vector<index_t> > steps;
+      index_t origin = slice(dimension, sizes, steps);
+      return HyperSlice<const T>(&data[0] + origin, sizes, steps);
+    }
 
     bool operator==(const HyperMatrix & rhs) const
     // Precondition: none
     // Postcondition: Return value is *this == rhs
-    {return data == rhs.data && dimensions == rhs.dimensions;}
+    {
+      return data == rhs.data && dimensions == rhs.dimensions &&
+        layout == rhs.layout;
+    }
 
     bool operator!=(const HyperMatrix & rhs) const
     // Precondition: none
@@ -108,22 +261,13 @@ namespace rlair_multi_clustering
 
       assert(ROW < COL);
 
-      // set indexer tuple
-      std::vector<int> tuple(ways);
-      for(int way = 0; way != ways; ++way)
-        if(dimension[way] == -1) tuple[way] = 0;
-
-      // build hyper-cube indexer
-      std::vector<bool> mask(ways, true); mask[ROW] = mask[COL] = false;
-      Indexer * indexer = new Indexer(*this, tuple, mask);
-
       // print
-      int ccount = 0;
-      while(!indexer->end())
+      HyperSlice<const T> cells = slice(dimension);
+      for(int row = 0; row != dimensions[ROW]; ++row)
       {
-        out << operator[](indexer->index());
-        if(++ccount % dimensions[COL] == 0) out << " " << std::endl;
-        indexer->forward();
+        for(int column = 0; column != dimensions[COL]; ++column)
+          out << cells(row, column);
+        out << " " << std::endl;
       }
     }
 
@@ -139,8 +283,36 @@ namespace rlair_multi_clustering
     }
 
     // MEMBER VARIABLES
-    std::vector<T> data;            // complete data
+    Array<T> data;                  // complete data
     std::vector<int> dimensions;    // size of each way
+    layout_t layout;                // order of the cells in data
+    std::vector<int> spans;         // units of a tile along each way (the
+                                    // size of each way if ROW_MAJOR)
+    std::vector<std::vector<index_t> > positions; // offset of each unit of
+                                    // each way
+
+  private:
+    index_t slice(const std::vector<int> & dimension,
+      std::vector<int> & sizes,
+      std::vector<std::vector<index_t> > & steps) const
+    // Precondition: dimension is -1 at the free ways and the unit of the
+    // others
+    // Postcondition: sizes and steps are the sizes and positions of the
+    // free ways; Return value is the offset of the cell with free ways at
+    // zero
+    // Library facilities used: assert
+    {
+      assert(dimension.size() == dimensions.size());
+      index_t origin = 0;
+      for(size_t way = 0; way != dimension.size(); ++way)
+        if(dimension[way] == -1)
+        {
+          sizes.push_back(dimensions[way]);
+          steps.push_back(positions[way]);
+        }
+        else origin += positions[way][dimension[way]];
+      return origin;
+    }
   };
 }
 
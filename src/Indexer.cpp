@@ -1,5 +1,5 @@
 // FILE: Indexer.cpp (part of namespace rlair_multi_clustering)
-// TEMPLATE CLASS implemented: Hyperator (see Indexer.h for documentation)
+// CLASSES implemented: Indexer, TileWalker (see Indexer.h for documentation)
 
 #include <cassert>                  // provides: assert
 #include "Indexer.h"
@@ -9,7 +9,7 @@ using namespace std;
 
 namespace rlair_multi_clustering
 {
-  Indexer::Indexer() {}
+  Indexer::Indexer() : offset(0), sub_offset(0), finished(true) {}
 
   Indexer::Indexer(indexes_t & indexes, mask_t & mask)
     : indexes(indexes), mask(mask)
@@ -24,7 +24,8 @@ namespace rlair_multi_clustering
       dimensions[way] = static_cast<int>(indexes[way].size());
 
     // initialize tuple
-    tuple = tuple_t(ways);
+    tuple.resize(ways);
+    initialize();
   }
 
   Indexer::Indexer(indexes_t & indexes, tuple_t & tuple, mask_t & mask)
@@ -39,6 +40,7 @@ namespace rlair_multi_clustering
     dimensions = dimensions_t(ways);
     for(size_t way = 0; way != ways; ++way)
       dimensions[way] = static_cast<int>(indexes[way].size());
+    initialize();
   }
 
   Indexer::Indexer(dimensions_t & dimensions, mask_t & mask)
@@ -52,6 +54,7 @@ namespace rlair_multi_clustering
 
     // initialize tuple
     tuple = tuple_t(dimensions.size());
+    initialize();
   }
 
   Indexer::Indexer
@@ -64,6 +67,7 @@ namespace rlair_multi_clustering
 
     // initialize tuple
     tuple = tuple_t(dimensions.size());
+    initialize();
   }
   
   Indexer::Indexer
@@ -72,6 +76,7 @@ namespace rlair_multi_clustering
   {
     dimensions = matrix.dimensions;
     indexes = matrix.indexes();
+    initialize();
   }
 
   Indexer::~Indexer() {}
@@ -81,6 +86,7 @@ namespace rlair_multi_clustering
   {
     for(size_t way = 0; way != tuple.size(); ++way)
       if(!mask[way]) tuple[way] = 0;
+    synchronize();
   }
 
   void Indexer::set(const tuple_t & tuple)
@@ -88,41 +94,27 @@ namespace rlair_multi_clustering
   {
     assert(this->tuple.size() == tuple.size());
     this->tuple = tuple;
+    synchronize();
   }
 
   void Indexer::forward()
   // Library facilities used: none
   {
-    // get dimensionality
-    int ways = static_cast<int>(dimensions.size());
-
-    // check if last item
-    bool last = true;
-    for(int i = 0; i != ways; ++i)
-      if(!mask[i]) if(tuple[i] != dimensions[i] - 1) last = false;
-    if(last)
+    // increment from last unmasked way, carrying into the previous ones
+    for(size_t i = 0; i != active.size(); ++i)
     {
-      // increment last unmasked index past last item
-      int i = ways - 1;
-      while(i >=0 && mask[i]) --i;
-      assert(i >= 0);
-      ++tuple[i];
-      return;
+      int way = active[i];
+      int position = tuple[way] + 1;
+      if(position != static_cast<int>(indexes[way].size()))
+      {
+        step(way, position);
+        return;
+      }
+      step(way, 0);
     }
 
-    // normal operation
-    bool carry = true;
-    for(int i = ways - 1; i >= 0; --i)
-    {
-      if(mask[i]) continue;
-      if(!carry) continue;
-
-      // reset index and continue
-      if(tuple[i] == dimensions[i] - 1) {tuple[i] = 0;}
-
-      // increment index and stop
-      else {++tuple[i]; carry = false;}
-    }
+    // carried past first unmasked way
+    finished = true;
   }
 
   Indexer::indexes_t Indexer::default_indexes()
@@ -140,54 +132,95 @@ namespace rlair_multi_clustering
     return indexes;
   }
 
-  int Indexer::index() const
-  // Library facilities used: none
-  {
-    return hyper_index(get_tuple(), dimensions);
-  }
-
-  bool Indexer::end() const
+  void Indexer::initialize()
   // Library facilities used: assert
   {
-    // check last unmasked index
-    int i = static_cast<int>(dimensions.size()) - 1;
-    while(i >=0 && mask[i]) --i;
-    assert(i >= 0);
-    return tuple[i] == dimensions[i];
+    int ways = static_cast<int>(dimensions.size());
+    assert(int(indexes.size()) == ways && int(mask.size()) == ways);
+
+    // strides of the matrix and of the hyper-plane of unmasked ways
+    strides = vector<index_t>(ways);
+    sub_strides = vector<index_t>(ways, 0);
+    active.clear();
+    index_t stride = 1;
+    index_t sub_stride = 1;
+    for(int way = ways - 1; way >= 0; --way)
+    {
+      strides[way] = stride;
+      stride *= dimensions[way];
+      if(mask[way]) continue;
+      sub_strides[way] = sub_stride;
+      sub_stride *= dimensions[way];
+      active.push_back(way);
+    }
+
+    synchronize();
   }
 
-  Indexer::tuple_t Indexer::get_tuple() const
+  void Indexer::synchronize()
   // Library facilities used: none
   {
-    tuple_t indexer_tuple = tuple;
-    for(size_t i = 0; i != tuple.size(); ++i)
-      indexer_tuple[i] = indexes[i][tuple[i]];
-    return indexer_tuple;
+    mapped = tuple;
+    offset = 0;
+    sub_offset = 0;
+    finished = false;
+    for(size_t way = 0; way != tuple.size(); ++way)
+    {
+      if(tuple[way] < static_cast<int>(indexes[way].size()))
+        mapped[way] = indexes[way][tuple[way]];
+      else if(!mask[way]) finished = true;
+      offset += index_t(mapped[way]) * strides[way];
+      sub_offset += index_t(mapped[way]) * sub_strides[way];
+    }
   }
 
-  Indexer::tuple_t Indexer::get_sub_tuple() const
-  // Library facilities used: none
+  TileWalker::TileWalker(const dimensions_t & spans,
+    const tuple_t & first, const tuple_t & last)
+    : spans(spans), first(first), last(last), finished(false)
+  // Library facilities used: assert
   {
-    tuple_t sub_tuple;
-    for(size_t i = 0; i != tuple.size(); ++i)
-      if(!mask[i]) sub_tuple.push_back(indexes[i][tuple[i]]);
-    return sub_tuple;
+    int ways = int(spans.size());
+    assert(int(first.size()) == ways && int(last.size()) == ways);
+    tile = tuple_t(ways);
+    for(int way = 0; way != ways; ++way)
+    {
+      assert(first[way] < last[way]);
+      tile[way] = first[way] / spans[way];
+    }
+    enter();
   }
 
-  Indexer::dimensions_t Indexer::get_sub_dimensions() const
+  void TileWalker::forward()
   // Library facilities used: none
   {
-    dimensions_t sub_dimensions;
-    for(size_t i = 0; i != dimensions.size(); ++i)
-      if(!mask[i]) sub_dimensions.push_back(dimensions[i]);
-    return sub_dimensions;
+    // next row of the tile: increment the ways but last, carrying
+    int ways = int(tuple.size());
+    for(int way = ways - 2; way >= 0; --way)
+    {
+      if(++tuple[way] != high(way)) return;
+      tuple[way] = low(way);
+    }
+
+    // past the last row: next tile of the box, in flat order of the tiles
+    for(int way = ways - 1; way >= 0; --way)
+    {
+      if(++tile[way] * spans[way] < last[way])
+      {
+        enter();
+        return;
+      }
+      tile[way] = first[way] / spans[way];
+    }
+
+    // carried past first way
+    finished = true;
   }
 
-  int Indexer::get_sub_index() const
+  void TileWalker::enter()
   // Library facilities used: none
   {
-    tuple_t sub_tuple = get_sub_tuple();
-    dimensions_t sub_dimensions = get_sub_dimensions();
-    return hyper_index(sub_tuple, sub_dimensions);
+    int ways = int(tile.size());
+    tuple.resize(ways);
+    for(int way = 0; way != ways; ++way) tuple[way] = low(way);
   }
 }
@@ -1,5 +1,6 @@
 // FILE: Indexer.h
-// CLASS PROVIDED: Indexer (part of the namespace rlair_multi_clustering)
+// CLASSES PROVIDED: Indexer, TileWalker (part of the namespace
+// rlair_multi_clustering)
 
 #ifndef RLAIR_MULTI_CLUSTERING_INDEXER
 #define RLAIR_MULTI_CLUSTERING_INDEXER
@@ -8,11 +9,21 @@
 
 #include <vector>                   // provides: vector
 #include <cassert>                  // provides: assert
+#include <cstddef>                  // provides: size_t
+#include <stdint.h>                 // provides: int64_t
 
 namespace rlair_multi_clustering
 {
+  // flat index of a cell (or count of cells); 64 bits so that tensors with
+  // more than 2^31 cells do not overflow
+  typedef int64_t index_t;
+
   template<class T> class HyperMatrix;
 
+  // Iterates over the tuples of a hyper-matrix (or of a selection of its
+  // indexes) in flat order, skipping masked ways. Strides are computed once;
+  // each step updates the flat index, the sub-index and the mapped tuple
+  // incrementally for the ways whose digit changed, without allocating.
   class Indexer
   {
   public:
@@ -28,6 +39,9 @@ namespace rlair_multi_clustering
     Indexer(indexes_t & indexes, tuple_t & tuple, mask_t & mask);
     Indexer(dimensions_t & dimensions, mask_t & mask);
     Indexer(const dimensions_t & dimensions, indexes_t & indexes, mask_t & mask);
+    // Precondition: indexes are within range of dimensions
+    // Postcondition: indexer iterates over indexes and index() is the flat
+    // index of the indexed tuple in a hyper-matrix of dimensions
     Indexer(const HyperMatrix<T> & matrix,
       const tuple_t & tuple, const mask_t & mask);
     ~Indexer();
@@ -45,16 +59,17 @@ namespace rlair_multi_clustering
     // indexes are incremented from last to first (like number system)
 
     // CONSTANT MEMBER FUNCTIONS
-    int index() const;
+    index_t index() const {return offset;}
     // Precondition: none
     // Postcondition: Return value is the flat index
-    bool end() const;
+    bool end() const {return finished;}
     // Precondition: none
     // Postcondition: Return value is true if reached past last item
-    tuple_t get_tuple() const;
+    const tuple_t & get_tuple() const {return mapped;}
     // Precondition: none
-    // Postcondition: Return value is tuple of indexes
-    int get_sub_index() const;
+    // Postcondition: Return value is tuple of indexes (valid until the
+    // indexer changes)
+    index_t get_sub_index() const {return sub_offset;}
     // Precondition: none
     // Postcondition: Return value is flat index of hyper-plane
 
@@ -65,32 +80,113 @@ namespace rlair_multi_clustering
     mask_t mask;              // masked indexes will not be iterated
 
   private:
+    std::vector<int> active;          // unmasked ways, last way first
+    std::vector<index_t> strides;     // stride of each way in dimensions
+    std::vector<index_t> sub_strides; // stride in hyper-plane (0 if masked)
+    tuple_t mapped;                   // indexes located by tuple
+    index_t offset;                   // flat index of mapped
+    index_t sub_offset;               // flat index of mapped in hyper-plane
+    bool finished;                    // reached past last item
 
     // UTILITY FUNCTIONS
     indexes_t default_indexes();
     // Precondition: none
     // Postcondition: Return value is vector of indexes starting at 0
-    tuple_t get_sub_tuple() const;
+    void initialize();
+    // Precondition: dimensions, indexes and mask are set
+    // Postcondition: strides and active ways are computed, and the tuple is
+    // synchronized
+    void synchronize();
+    // Precondition: strides are computed
+    // Postcondition: mapped, offsets and finished agree with tuple
+    void step(int way, int position)
+    // Precondition: way is unmasked, position < number of indexes of way
+    // Postcondition: tuple[way] == position, mapped and offsets are updated
+    // Library facilities used: none
+    {
+      int value = indexes[way][position];
+      index_t change = index_t(value - mapped[way]);
+      offset += change * strides[way];
+      sub_offset += change * sub_strides[way];
+      mapped[way] = value;
+      tuple[way] = position;
+    }
+  };
+
+  // Iterates over the rows of the cells of a box of a hyper-matrix stored
+  // in tiles (see HyperMatrix), tile after tile in the order they are
+  // stored and the rows of each tile in flat order. A row is a run of the
+  // cells of a tile along the last way, contiguous in memory; only the
+  // units in [first, last) of each way are visited.
+  class TileWalker
+  {
+  public:
+    typedef std::vector<int> tuple_t;
+    typedef std::vector<int> dimensions_t;
+
+    // CONSTRUCTORS and DESTRUCTORS
+    TileWalker(const dimensions_t & spans,
+      const tuple_t & first, const tuple_t & last);
+    // Precondition: spans are the units of a tile along each way, and
+    // first[way] < last[way] for every way
+    // Postcondition: walker is at the first row of the first tile of the box
+
+    // MODIFICATION MEMBER FUNCTIONS
+    void forward();
     // Precondition: none
-    // Postcondition: Return value is tuple of indexes excluding masked indexs
-    dimensions_t get_sub_dimensions() const;
+    // Postcondition: walker is at the next row, in the next tile of the box
+    // past the last row of a tile
+
+    // CONSTANT MEMBER FUNCTIONS
+    bool end() const {return finished;}
+    // Precondition: none
+    // Postcondition: Return value is true if reached past last row
+    const tuple_t & get_tuple() const {return tuple;}
+    // Precondition: none
+    // Postcondition: Return value is the tuple of the first cell of the row
+    int length() const {return high(int(tuple.size()) - 1) - tuple.back();}
     // Precondition: none
-    // Postcondition: Return value is dimensions excluding masked indexs
+    // Postcondition: Return value is the number of cells of the row
+
+  private:
+    dimensions_t spans;       // units of a tile along each way
+    tuple_t first;            // first unit of the box along each way
+    tuple_t last;             // past the last unit of the box along each way
+    tuple_t tile;             // current tile along each way
+    tuple_t tuple;            // first cell of the current row
+    bool finished;            // reached past last row
+
+    // UTILITY FUNCTIONS
+    int low(int way) const
+    // Precondition: way is within range
+    // Postcondition: Return value is the first unit of way visited in tile
+    // Library facilities used: none
+    {
+      int unit = tile[way] * spans[way];
+      return unit < first[way] ? first[way] : unit;
+    }
+    int high(int way) const
+    // Precondition: way is within range
+    // Postcondition: Return value is past the last unit of way visited in
+    // tile
+    // Library facilities used: none
+    {
+      int unit = (tile[way] + 1) * spans[way];
+      return unit > last[way] ? last[way] : unit;
+    }
+    void enter();
+    // Precondition: tile is within the box
+    // Postcondition: tuple is the first cell of tile in the box
   };
 
-  inline int hyper_index
+  inline index_t hyper_index
   (const std::vector<int> & tuple, const std::vector<int> & dimensions)
   // Library facilities used: assert
   {
     assert(tuple.size() == dimensions.size());
-    int ways = static_cast<int>(dimensions.size());
-    int index = 0;
-    for(int i = 0; i < ways; ++i)
-    {
-      int prod = 1;
-      for(int j = i + 1; j < ways; ++j) prod *= dimensions[j];
-      index += prod * tuple[i];
-    }
+    index_t index = 0;
+    for(size_t i = 0; i != dimensions.size(); ++i)
+      index = index * dimensions[i] + tuple[i];
     return index;
   }
 }
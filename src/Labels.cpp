@@ -0,0 +1,125 @@
+// FILE: Labels.cpp (part of namespace rlair_multi_clustering)
+// CLASS implemented: Labels (see Labels.h for documentation)
+
+#include <cstdlib>                  // provides: exit
+#include <iostream>                 // provides: cerr
+#include <cassert>                  // provides: assert
+#include "Labels.h"
+#include "Data.h"
+
+using namespace std;
+
+namespace rlair_multi_clustering
+{
+  Labels::Labels() : indexed(true), resolved(true) {}
+
+  void Labels::open(const string & pathname, const vector<int> & sizes)
+  // Library facilities used: none
+  {
+    this->pathname = pathname;
+    this->sizes = sizes;
+    first.clear();
+    offsets.clear();
+    text.clear();
+    indexed = false;
+    resolved = false;
+  }
+
+  void Labels::assign(const vector<size_t> & first,
+    const vector<size_t> & offsets)
+  // Library facilities used: none
+  {
+    this->first = first;
+    this->offsets = offsets;
+    text.clear();
+    indexed = true;
+    resolved = false;
+  }
+
+  string Labels::operator()(int way, int unit) const
+  // Library facilities used: assert
+  {
+    resolve();
+    assert(way + 1 < int(first.size()));
+    size_t label = first[way] + unit;
+    assert(label < first[way + 1]);
+
+    // a label runs up to the next one, less the line ends between them
+    const char * begin = text.empty() ? "" : &text[0];
+    const char * stop = begin + offsets[label + 1];
+    while(stop != begin + offsets[label] &&
+      (stop[-1] == '\n' || stop[-1] == '\r'))
+      --stop;
+    return string(begin + offsets[label], stop);
+  }
+
+  size_t Labels::bytes() const
+  // Library facilities used: none
+  {
+    return text.size();
+  }
+
+  void Labels::index() const
+  // Library facilities used: map_file
+  {
+    if(indexed) return;
+    size_t size = 0;
+    const char * file = map_file(pathname, size);
+    if(file == NULL) {cerr << "error opening " << pathname << endl; exit(1);}
+    index(file, size);
+    unmap_file(file, size);
+  }
+
+  void Labels::resolve() const
+  // Library facilities used: map_file
+  {
+    if(resolved) return;
+
+    size_t size = 0;
+    const char * file = map_file(pathname, size);
+    if(file == NULL) {cerr << "error opening " << pathname << endl; exit(1);}
+    if(!indexed) index(file, size);
+    if(offsets.back() > size)
+    {
+      cerr << "error: " << pathname << " changed while in use" << endl;
+      exit(1);
+    }
+    text.assign(file, file + offsets.back());
+    unmap_file(file, size);
+    resolved = true;
+  }
+
+  void Labels::index(const char * file, size_t size) const
+  // Library facilities used: none
+  {
+    // each way lists one label per line, ways separated by a blank line
+    int ways = int(sizes.size());
+    offsets.clear();
+    first.assign(1, 0);
+    const char * p = file;
+    const char * end = file + size;
+    while(p != end && int(first.size()) <= ways)
+    {
+      const char * line = p;
+      while(p != end && *p != '\n') ++p;
+      const char * stop = p;
+      if(stop != line && stop[-1] == '\r') --stop;
+      if(p != end) ++p;
+      if(stop == line) {first.push_back(offsets.size()); continue;}
+      offsets.push_back(line - file);
+    }
+    while(int(first.size()) <= ways) first.push_back(offsets.size());
+    offsets.push_back(p - file);
+
+    // check
+    for(int way = 0; way != ways; ++way)
+      if(int(first[way + 1] - first[way]) != sizes[way])
+      {
+        cerr << "error: " << pathname << " has " << first[way + 1] - first[way]
+          << " labels for way " << way << " of size " << sizes[way] << endl;
+        exit(1);
+      }
+
+    indexed = true;
+  }
+}
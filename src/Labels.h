@@ -0,0 +1,72 @@
+// FILE: Labels.h
+// CLASS PROVIDED: Labels (part of the namespace rlair_multi_clustering)
+
+#ifndef RLAIR_MULTI_CLUSTERING_LABELS
+#define RLAIR_MULTI_CLUSTERING_LABELS
+
+#include <string>                   // provides: string
+#include <vector>                   // provides: vector
+#include <cstddef>                  // provides: size_t
+
+namespace rlair_multi_clustering
+{
+  // Labels of the units of each way, kept in one character arena (a copy
+  // of the labels file) with a table of the offset of each label in it. The
+  // labels file is only read when a label is first requested (normally when
+  // the clusterings are printed); the table may be given beforehand (from
+  // the binary cache) so that the file is then copied without being
+  // scanned.
+  class Labels
+  {
+  public:
+    // CONSTRUCTORS and DESTRUCTOR
+    Labels();
+
+    // MODIFICATION MEMBER FUNCTIONS
+    void open(const std::string & pathname, const std::vector<int> & sizes);
+    // Precondition: sizes is the number of units of each way
+    // Postcondition: labels will be read from pathname on first access
+    void assign(const std::vector<size_t> & first,
+      const std::vector<size_t> & offsets);
+    // Precondition: open has been called, and arguments are the table of
+    // the labels file (as built by index)
+    // Postcondition: labels will be read from the file on first access,
+    // at the given offsets
+
+    // CONSTANT MEMBER FUNCTIONS
+    std::string operator()(int way, int unit) const;
+    // Precondition: way and unit are within range
+    // Postcondition: Return value is the label of unit of way
+    size_t bytes() const;
+    // Precondition: none
+    // Postcondition: Return value is memory used by the label characters
+    // read so far (0 until the labels are first used)
+    void index() const;
+    // Precondition: none
+    // Postcondition: the table of the labels has been built from file (the
+    // characters are not kept)
+    void resolve() const;
+    // Precondition: none
+    // Postcondition: labels have been read from file
+
+    // MEMBER VARIABLES (first and offsets valid after index, text after
+    // resolve)
+    mutable std::vector<size_t> first;    // index of first label of each way
+    mutable std::vector<size_t> offsets;  // start of each label in the file
+                                          // (and end of the last one)
+    mutable std::vector<char> text;       // characters of the file up to
+                                          // the end of the last label
+
+  private:
+    void index(const char * file, size_t size) const;
+    // Precondition: file holds the size characters of the labels file
+    // Postcondition: first and offsets are its table
+
+    std::string pathname;                 // labels file
+    std::vector<int> sizes;               // number of units of each way
+    mutable bool indexed;                 // table has been built
+    mutable bool resolved;                // labels have been read
+  };
+}
+
+#endif
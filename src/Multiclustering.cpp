@@ -9,21 +9,29 @@ using namespace std;
 
 namespace rlair_multi_clustering
 {
-  Multiclustering::Multiclustering() : data(NULL), lout(NULL) {}
+  Multiclustering::Multiclustering()
+  : data(NULL), options(NULL), lout(NULL), counted(false), model_cost(0),
+    data_cost(0), costed(false), keeping(false) {}
 
-  Multiclustering::Multiclustering(Data * data, ostream * lout)
-  : data(data), lout(lout)
+  Multiclustering::Multiclustering
+  (Data * data, Options * options, ostream * lout)
+  : data(data), options(options), lout(lout), counted(false), model_cost(0),
+    data_cost(0), costed(false), keeping(false)
   // Library facilities used: none
   {initialize();}
   
   Multiclustering::Multiclustering
-  (Data * data, std::ostream * lout, std::vector<int> & clusters)
-  : data(data), lout(lout)
+  (Data * data, Options * options, std::ostream * lout,
+    std::vector<int> & clusters)
+  : data(data), options(options), lout(lout), counted(false), model_cost(0),
+    data_cost(0), costed(false), keeping(false)
   // Library facilities used: none
   {initialize(clusters);}
 
   Multiclustering::Multiclustering(const Multiclustering & source)
-  : data(source.data), lout(source.lout)
+  : data(source.data), options(source.options), lout(source.lout),
+    counted(false), model_cost(0), data_cost(0), costed(false),
+    keeping(false)
   // Library facilities used: none
   {copy(source);}
 
@@ -31,8 +39,18 @@ namespace rlair_multi_clustering
   // Library facilities used: none
   {
     data = source.data;
+    options = source.options;
     clusterings = source.clusterings;
+    assignments = source.assignments;
+    block_table = source.block_table;
+    counted = source.counted;
+    model_cost = source.model_cost;
+    data_cost = source.data_cost;
+    costed = source.costed;
     lout = source.lout;
+    kept.clear();
+    moving.clear();
+    keeping = false;
   }
 
   void Multiclustering::initialize()
@@ -57,17 +75,32 @@ namespace rlair_multi_clustering
     int ways = data->ways();
     vector<int> cluster(ways);
     clusterings = vector<clustering_t>(ways);
+    assignments = vector<assignment_t>(ways);
+    counted = false;
+    costed = false;
     for(int way = 0; way != ways; ++way)
     {
       clusterings[way] = clustering_t(clusters[way]);
-      for(int i = 0; i != data->matrix.dimensions[way]; ++i)
+      for(int i = 0; i != data->dimensions()[way]; ++i)
       {
         clusterings[way][cluster[way]].push_back(i);
         cluster[way] = (cluster[way] + 1) % clusters[way];
       }
+      assign(way);
     }
   }
 
+  void Multiclustering::assign(int way)
+  // Library facilities used: vector
+  {
+    keeping = false;
+    assignment_t & assignment = assignments[way];
+    assignment = assignment_t(data->dimensions()[way], -1);
+    for(int cluster = 0; cluster != int(clusterings[way].size()); ++cluster)
+      for(int i = 0; i != int(clusterings[way][cluster].size()); ++i)
+        assignment[clusterings[way][cluster][i]] = cluster;
+  }
+
   int Multiclustering::blocking_size() const
   // Library facilities used: none
   {
@@ -86,6 +119,23 @@ namespace rlair_multi_clustering
     return size;
   }
 
+  template<int Ways>
+  void Multiclustering::get_blocking(Blocking<Ways> & blocking, int way)
+  const
+  // Library facilities used: vector
+  {
+    for(int w = 0; w != Ways; ++w)
+    {
+      blocking.dimensions[w] = data->dimensions()[w];
+      blocking.clusters[w] = int(clusterings[w].size());
+      blocking.assignments[w] = &assignments[w][0];
+    }
+    if(way == -1) return;
+    blocking.zeros.assign(data->dimensions()[way], 0);
+    blocking.clusters[way] = 1;
+    blocking.assignments[way] = &blocking.zeros[0];
+  }
+
 
   Indexer Multiclustering::blocking_indexer(int way, int cluster)
   // Library facilities used: assert
@@ -132,7 +182,10 @@ namespace rlair_multi_clustering
     Indexer::mask_t mask(ways);
     mask[way] = true;
 
-    return Indexer(indexes, tuple, mask);
+    // flat index is that of the matrix cell
+    Indexer indexer(data->dimensions(), indexes, mask);
+    indexer.set(tuple);
+    return indexer;
   }
 
   multicluster_t Multiclustering::get_block(const Indexer::tuple_t & tuple)
@@ -154,14 +207,20 @@ namespace rlair_multi_clustering
     return dimensions;
   }
 
-  int Multiclustering::block_size(const Indexer::tuple_t & tuple) const
+  index_t Multiclustering::block_size(const Indexer::tuple_t & tuple) const
   // Library facilities used: none
   {
     int ways = data->ways();
     assert(int(tuple.size()) == ways);
-    int size = 1;
+    index_t size = 1;
     for(int way = 0; way != ways; ++way)
-      size *= int(clusterings[way][tuple[way]].size());
+      size *= index_t(clusterings[way][tuple[way]].size());
     return size;
   }
+
+  // ranks of the sweeps specialized on the number of ways (see kernels.h)
+  template void Multiclustering::get_blocking
+    (Blocking<2> & blocking, int way) const;
+  template void Multiclustering::get_blocking
+    (Blocking<3> & blocking, int way) const;
 }
@@ -9,9 +9,17 @@
 #include <iomanip>                  // provides: setw, fixed, setprecision
 #include <climits>                  // provides: INT_MAX
 #include <cfloat>                   // provides: DBL_MAX
+#include <cmath>                    // provides: log
+#include <stdint.h>                 // provides: uint16_t, int32_t
+#include <utility>                  // provides: pair
+#include <map>                      // provides: map
+
+#include "Arena.h"
 
 #include "Data.h"
 #include "Indexer.h"
+#include "ThreadPool.h"
+#include "kernels.h"
 
 #define BOOST_FILESYSTEM_VERSION 3
 
@@ -19,19 +27,57 @@
 
 namespace rlair_multi_clustering
 {
-  typedef std::vector<int> counts_t;
+  typedef std::vector<index_t> counts_t;
   typedef std::vector<int> cluster_t;
   typedef std::vector<double> frequencies_t;
   typedef std::vector<cluster_t> clustering_t;
   typedef std::vector<cluster_t> multicluster_t;
+  typedef std::vector<int> assignment_t;
+
+  const index_t SLAB = 1 << 16;       // fewest cells counted by a thread
+  const int SWEEP_PARTS = 4;          // parts of a sweep per thread
+  const size_t PRUNE_CHUNKS = 8;      // chunks of the row of a candidate,
+                                      // with bound checks between (pruning)
+
+  // counts of the work done by the multiclusterings of a search
+  struct Statistics
+  {
+    Statistics() : cost_hits(0), cost_misses(0), candidates_costed(0),
+      candidates_pruned(0), products_costed(0), products_pruned(0) {}
+    size_t cost_hits;                 // costs read from the cache
+    size_t cost_misses;               // costs evaluated
+    size_t candidates_costed;         // clusters fully costed for a unit
+                                      // (pruning)
+    size_t candidates_pruned;         // clusters dropped for a unit by
+                                      // their bound
+    size_t products_costed;           // products of counts and code lengths
+                                      // added
+    size_t products_pruned;           // products not added, of the clusters
+                                      // dropped
+  };
+
+  // options of a search, set by the driver and shared by the
+  // multiclusterings of the search (copies point to the same options)
+  struct Options
+  {
+    Options() : threads(1), prune(false) {}
+    int threads;                      // threads counting blocks and placing
+                                      // units
+    bool prune;                       // drop the clusters a unit cannot
+                                      // move to by a bound of their cost
+    ThreadPool pool;                  // workers of the threads, reused by
+                                      // the sweeps of the search
+    Statistics statistics;            // work done by the search so far
+  };
 
   class Multiclustering
   {
   public:
     // CONSTRUCTORS and DESTRUCTOR
     Multiclustering();
-    Multiclustering(Data * data, std::ostream * lout);
-    Multiclustering(Data * data, std::ostream * lout, std::vector<int> & clusters);
+    Multiclustering(Data * data, Options * options, std::ostream * lout);
+    Multiclustering(Data * data, Options * options, std::ostream * lout,
+      std::vector<int> & clusters);
     Multiclustering(const Multiclustering & source);
 
     // MODIFICATION MEMBER FUNCTIONS
@@ -52,21 +98,48 @@ namespace rlair_multi_clustering
     // Postcondition: clusterings have clusters per mode
     bool optimize(int way);
     // Precondition: way < matrix ways
-    // Postcondition: all units in way have been placed in best clusters
+    // Postcondition: all units in way have been placed in best clusters; a
+    // sweep that would move a single unit moves it only if move_cost is
+    // negative. Return value is true if a unit moved
     bool add_cluster(int way);
     // Precondition: way is a valid data matrix way
     // Postcondition: multiclustering has one additional cluster in way
+    int ingest(const std::vector<Data::update_t> & batch);
+    // Precondition: tuples of batch are within range
+    // Postcondition: batch is applied to data, the counts of the blocks it
+    // touches and the kept signatures of the units it touches are updated,
+    // and each unit involved in batch has been placed in its best cluster;
+    // Return value is number of units moved. The cost is proportional to
+    // the batch and to the slices of the units that move, except when the
+    // blocks or signatures are not current (the first call after the
+    // clusterings changed otherwise, or after a cluster was emptied), which
+    // counts them over the whole matrix
+    void reload(Data * data);
+    // Precondition: data has the ways and way sizes of the current data
+    // Postcondition: the multiclustering keeps its clusterings over data,
+    // its blocks counted again when next read
+    double move_cost(int way, int unit, int new_cluster);
+    // Precondition: unit and new_cluster are within range of way
+    // Postcondition: Return value is the exact change of cost() if unit
+    // moved from its cluster to new_cluster (an emptied cluster being
+    // erased), computed from the block counts in O(blocks x values)
 
     // CONSTANT MEMBER FUNCTIONS
     double cost();
     // Precondition: data, clusterings, and blocks have been initialized
-    // Postcondition: Return value is data encoding cost
+    // Postcondition: Return value is data encoding cost (evaluated only if
+    // clusterings or block counts changed since it was last evaluated)
     double model_encoding_cost();
     // Precondition: data, clusterings, and blocks have been initialized
-    // Postcondition: Return value is model description length
+    // Postcondition: Return value is model description length (as cost)
     double data_encoding_cost();
     // Precondition: blocks has been initialized
-    // Postcondition: Return value is data description length
+    // Postcondition: Return value is data description length (as cost)
+    void get_block_counts
+    (counts_t & counts, const Indexer::tuple_t & tuple) const;
+    // Precondition: tuple indexes a block (a cluster of each way)
+    // Postcondition: counts are the value counts of block, read from
+    // block_table (counted first if it is not current)
     void print_2D_slice
     (const std::vector<int> & dimension, const std::string & file) const;
     void print_2D_slice
@@ -82,12 +155,162 @@ namespace rlair_multi_clustering
 
     // MEMBER VARIABLES
     Data * data;                                // pointer to data
+    Options * options;                          // pointer to search options
     std::vector<clustering_t> clusterings;      // clusters of units
     std::ostream * lout;                        // pointer to log file
 
+    // slab of the matrix whose blocks are counted by one thread
+    struct Slab
+    {
+      const Multiclustering * owner;
+      index_t begin;                            // first row or nonzero
+      index_t end;                              // past last row or nonzero
+      counts_t table;                           // blocks x values counts
+    };
+
+    // candidate clusters of the units of a part, costed chunk by chunk
+    // (pruning)
+    struct Candidates
+    {
+      Candidates() : costed(0), pruned(0), products(0), skipped(0) {}
+      std::vector<double> lanes;                // partial sums per cluster
+      std::vector<double> rest;                 // least cost of the unit
+                                                // from each chunk on
+      std::vector<std::pair<double, int> > order; // bound and cluster
+      size_t costed;                            // candidates fully costed
+      size_t pruned;                            // candidates dropped
+      size_t products;                          // products added
+      size_t skipped;                           // products not added
+    };
+
+    // units of a way swept by the threads of the pool, in parts of
+    // consecutive units (the units of each cluster in turn)
+    struct Sweep
+    {
+      Multiclustering * owner;
+      int way;
+      int cluster;                              // first cluster swept
+      int parts;                                // parts of the units
+      std::vector<int> first;                   // first unit of each
+                                                // cluster, and past last
+      void * signatures;                        // blocks x values counters
+                                                // per unit (of the type
+                                                // of the task)
+      const std::vector<int> * slot;            // unit of signatures of
+                                                // each unit of way, or -1
+      const double * lengths;                   // code lengths per cluster
+      double * scores;                          // cost of each unit in each
+                                                // cluster
+      std::vector<int> * new_assignments;       // best cluster of each unit
+      std::vector<Candidates> * candidates;     // of each part if pruning,
+                                                // or NULL
+      const double * least;                     // least code length of each
+                                                // entry over the clusters
+                                                // (pruning)
+    };
+
   private:
+    std::vector<assignment_t> assignments;      // cluster of each unit
+    mutable std::vector<counts_t> block_table;  // value counts of each block,
+                                                // kept current as units move
+    mutable bool counted;                       // block_table is current
+    double model_cost;                          // model part of cost
+    double data_cost;                           // data part of cost
+    bool costed;                                // model_cost and data_cost
+                                                // are current
+    Arena arena;                                // buffers of the sweeps
+                                                // (not copied)
+    std::vector<counts_t> kept;                 // signature of each unit of
+                                                // each way (units x blocks
+                                                // x values, counts of zero
+                                                // unused if zeros are
+                                                // implicit), for ingest
+    bool keeping;                               // kept is current (not
+                                                // copied)
+    std::map<std::pair<int, int>, std::pair<int, int> > moving; // first and
+                                                // last cluster of each way
+                                                // and unit moved whose
+                                                // slice is still to be
+                                                // moved in kept (TILED, a
+                                                // single way)
 
     // UTILITY MEMBER FUNCTIONS
+    void assign(int way);
+    // Precondition: way < matrix ways
+    // Postcondition: assignments[way] maps each unit to its cluster; kept
+    // is no longer current
+    void evaluate_costs();
+    // Precondition: none
+    // Postcondition: model_cost and data_cost are current (computed from
+    // block_table unless costed), and the hit or miss is counted
+    double model_encoding() const;
+    // Precondition: none
+    // Postcondition: Return value is model description length, computed
+    // from block_table
+    double data_encoding() const;
+    // Precondition: none
+    // Postcondition: Return value is data description length, computed
+    // from block_table
+    void count_blocks() const;
+    // Precondition: none
+    // Postcondition: block_table has value counts of every block (indexed by
+    // flat block index), counted in a single sweep over the matrix; the log
+    // tables cover the largest block
+    int block_index(int way, int cluster, int sub_index) const;
+    // Precondition: sub_index indexes a block of the hyper-plane of way
+    // Postcondition: Return value is flat index of the block in cluster
+    bool place(int way, int unit);
+    // Precondition: block_table is current
+    // Postcondition: unit is moved to the cluster of way that lowers the
+    // cost the most (if any) and block_table is updated; Return value is
+    // true if unit moved
+    void move_unit(int way, int unit, int new_cluster,
+      const std::vector<counts_t> & signature);
+    // Precondition: block_table is current, signature is the signature of
+    // unit (see get_unit_signature), new_cluster is not its cluster
+    // Postcondition: unit is in new_cluster (in order of units if it was
+    // sorted) and block_table is updated (and kept, if current); an emptied
+    // cluster is erased (clusters after it are renumbered, and kept is no
+    // longer current)
+    bool implicit_zeros() const;
+    // Precondition: none
+    // Postcondition: Return value is true if the storage lists only the
+    // nonzeros (SPARSE and BINARY), whose zeros are the rest of each block
+    void keep_signatures();
+    // Precondition: none
+    // Postcondition: kept has the signature of every unit of every way,
+    // counted over the matrix, and keeping is true
+    void keep_cell(const std::vector<int> & tuple, Data::T old_value,
+      Data::T new_value);
+    // Precondition: kept is current before the cell changed
+    // Postcondition: kept has the cell counted with new_value instead of
+    // old_value in the signature of its unit of each way
+    void keep_move(int way, int unit, int old_cluster, int new_cluster);
+    // Precondition: kept is current before unit of way moved from
+    // old_cluster to new_cluster (and no cluster was erased)
+    // Postcondition: kept has the cells of the slice of unit moved to their
+    // new blocks in the signatures of the units of the other ways; if TILED,
+    // the move is listed in moving instead (the signatures of way are
+    // current, those of the other ways once keep_moves is called)
+    void keep_moves();
+    // Precondition: none
+    // Postcondition: the slices of the units listed in moving are moved in
+    // kept, in one sweep over the tiles, and moving is empty
+    void move_cell(const int * tuple, Data::T value, int way,
+      int old_cluster, int new_cluster);
+    // Precondition: tuple is a cell of value in the slice of a unit of way
+    // that moves from old_cluster to new_cluster, kept is current before
+    // Postcondition: the cell is moved to its new block in the signature of
+    // its unit of each other way
+    void kept_signature(std::vector<counts_t> & signature, int way,
+      int unit) const;
+    // Precondition: kept is current
+    // Postcondition: signature is the signature of unit, read from kept
+    // (see get_unit_signature)
+    double move_cost(int way, int unit, int new_cluster,
+      const std::vector<counts_t> & signature) const;
+    // Precondition: signature is the signature of unit
+    // Postcondition: same as move_cost(way, unit, new_cluster)
     void print_clustered_row
     (int ROW, int cluster, int row, int COL, int cluster_z, int index_z, std::ostream & out, bool model) const;
     // Precondition: cluster is row cluster, row is row in cluster
@@ -105,7 +328,8 @@ namespace rlair_multi_clustering
     // Postcondition: Return value is indexer for blocks around way cluster
     Indexer block_indexer(multicluster_t & block, int way, int unit_index);
     // Precondition: way < block ways, unit < way cluster size
-    // Postcondition: Return value is indexer for block units around way unit
+    // Postcondition: Return value is indexer for block units around way
+    // unit; its flat index is that of the matrix cell
     multicluster_t get_block(const Indexer::tuple_t & tuple);
     // Precondition: tuple is valid
     // Postcondition: Return value is multicluster indexed by tuple
@@ -114,21 +338,86 @@ namespace rlair_multi_clustering
     (std::vector<counts_t> & signature, int way, int cluster, int unit_index);
     // Precondition: way < ways, cluster < way clusters, unit < cluster units
     // Postcondition: Return value is unit's value counts for each block
+    index_t largest_count(int way) const;
+    // Precondition: way < ways
+    // Postcondition: Return value is the most cells a unit of way can have
+    // in a block (product of the largest cluster of each other way)
+    template<class C>
+    void get_signatures(C * signatures, int way, int cluster);
+    // Precondition: way < ways, cluster < way clusters or cluster == -1, C
+    // holds largest_count(way), signatures are zero with room for the
+    // blocks x values entries of each unit counted
+    // Postcondition: signatures has the signatures of the units of cluster
+    // (of every cluster of way in turn if cluster == -1) one after the
+    // other, in contiguous blocks x values entries per unit, counted in
+    // one sweep over their cells; units are split among the threads of the
+    // pool (one thread if TILED)
+    template<class C>
+    void count_signatures(C * signatures, int way,
+      const std::vector<int> & slot, int begin, int end) const;
+    // Precondition: data storage is not TILED, signatures are zero, slot[u]
+    // is the index in signatures of unit u of way or -1 if not counted
+    // Postcondition: signatures of the units [begin, end) with a slot have
+    // the counts of their cells, as in get_unit_signature
+    template<class C>
+    void count_dense_signatures(C * signatures, int way,
+      const std::vector<int> & slot, int begin, int end) const;
+    // Precondition: data storage is DENSE, others as in count_signatures
+    // Postcondition: same as count_signatures, each row of the matrix read
+    // once (by each range of units if way is the last), or each cell of the
+    // units read once in storage order if the matrix layout is BLOCKED
+    template<class C>
+    void count_binary_signatures(C * signatures, int way,
+      const std::vector<int> & slot, int begin, int end) const;
+    // Precondition: data storage is BINARY, others as in count_signatures
+    // Postcondition: signatures have the ones of the units, each row read
+    // once (by each range of units if way is the last)
+    template<class C>
+    void count_sparse_signatures(C * signatures, int way,
+      const std::vector<int> & slot, int begin, int end) const;
+    // Precondition: data storage is SPARSE, others as in count_signatures
+    // Postcondition: signatures have the nonzeros of the units
+    template<class C, int Ways>
+    void count_ranked_sparse_signatures(C * signatures, int way,
+      const std::vector<int> & slot, int begin, int end) const;
+    // Precondition: same as count_sparse_signatures, data has Ways ways
+    // Postcondition: same as count_sparse_signatures
     bool optimize(int way, int unit);
     // Precondition: way < matrix ways, unit < way units
     // Postcondition: way unit is placed in optimum way cluster
     // faster (04/22/12)
-    bool optimize(int way, int old_cluster, int index,
-      std::vector<std::vector<counts_t> > & units_signatures,
-      std::vector<std::vector<counts_t> > & clusters_signatures,
+    bool optimize(int way, int old_cluster, int index, const double * costs,
       std::vector<int> & new_assignments);
-    // Precondition: way < matrix ways, unit < way units
+    // Precondition: way < matrix ways, unit < way units, costs are the
+    // costs of encoding the unit in each cluster of way
     // Postcondition: way unit is placed in optimum way cluster
+    template<class C>
+    bool place_pruned(int way, int old_cluster, int index, const C * counts,
+      const double * lengths, const double * least, Candidates & candidates,
+      std::vector<int> & new_assignments);
+    // Precondition: same as optimize(way, old_cluster, index, ...), counts
+    // are the signature of the unit, lengths the code lengths of the values
+    // in each cluster (blocks x values entries per cluster) and least their
+    // least value over the clusters
+    // Postcondition: same as optimize(way, old_cluster, index, ...); the
+    // cluster of the unit is costed first and the others in order of a
+    // lower bound of their cost, each dropped once the bound cannot beat
+    // the best, and candidates counts them
+    template<class C>
+    bool sweep_way(int way);
+    // Precondition: way < matrix ways, C holds largest_count(way)
+    // Postcondition: same as optimize(way), the unit signatures counted in
+    // C and the buffers taken from arena
+    template<class C>
+    bool split_units(int way, int cluster);
+    // Precondition: cluster is the cluster of way to split, C holds
+    // largest_count(way)
+    // Postcondition: same as add_cluster(way)
     int split_cluster(int way);
     // Precondition: way is a valid data matrix way
     // Postcondition: Return value is index of cluster to split
-    double cluster_cost(const std::vector<counts_t> & block_counts);
-    // Precondition: block_counts for all blocks
+    double cluster_cost(const index_t * block_counts, int blocks);
+    // Precondition: block_counts has values entries for each of blocks
     // Postcondition: Return value is cost of blocks
     double cluster_cost(int way, int cluster);
     // Precondition: way is a valid data matrix way, cluster < way clusters
@@ -137,7 +426,7 @@ namespace rlair_multi_clustering
     Indexer::dimensions_t blocking_dimensions() const;
     // Precondition: none
     // Postcondition: Return value is dimensions of the blocking (e.g., K x L)
-    int block_size(const Indexer::tuple_t & tuple) const;
+    index_t block_size(const Indexer::tuple_t & tuple) const;
     // Precondition: none
     // Postcondition: Return value is number of units in block
     double block_cost(const Indexer::tuple_t & tuple) const;
@@ -146,34 +435,154 @@ namespace rlair_multi_clustering
     frequencies_t block_frequencies(const Indexer::tuple_t & tuple) const;
     // Precondition: none
     // Postcondition: Return value is frequency of each value in block
-    void get_block_counts
-    (counts_t & counts, const Indexer::tuple_t & tuple) const;
+    void get_way_signatures(counts_t & signatures, int way) const;
     // Precondition: none
-    // Postcondition: Return value is number of units in block
+    // Postcondition: signatures[(c * blocks + b) * values + v] is the count
+    // of value v in block b of the hyper-plane of cluster c of way, read
+    // from block_table
+    void set_way_signatures(int way, const index_t * signatures);
+    // Precondition: clusterings and assignments are current; signatures
+    // points to the blocks of the hyper-plane of each cluster of way
+    // Postcondition: block_table holds signatures and is current; costs are
+    // evaluated again when next read
+    void count_dense_blocks
+    (counts_t & table, index_t begin, index_t end) const;
+    // Precondition: data storage is DENSE, table has values entries per
+    // block, [begin, end) are rows (tuples of the ways but last), or layers
+    // of tiles along the first way if the matrix layout is BLOCKED
+    // Postcondition: table[block * values + value] is incremented for each
+    // cell of the rows (or layers), in one sweep in storage order
+    void count_binary_blocks
+    (counts_t & table, index_t begin, index_t end) const;
+    // Precondition: data storage is BINARY, table and rows as in
+    // count_dense_blocks
+    // Postcondition: table has the ones of the rows added to their blocks,
+    // counted with popcount per cluster of the last way
+    void count_sparse_blocks
+    (counts_t & table, index_t begin, index_t end) const;
+    // Precondition: data storage is SPARSE, table as in count_dense_blocks,
+    // [begin, end) are nonzeros
+    // Postcondition: table has the nonzeros added to their blocks
+    template<int Ways>
+    void count_ranked_sparse_blocks
+    (counts_t & table, index_t begin, index_t end) const;
+    // Precondition: same as count_sparse_blocks, data has Ways ways
+    // Postcondition: same as count_sparse_blocks
+    Indexer::tuple_t row_tuple(index_t row) const;
+    // Precondition: row < product of the sizes of the ways but last
+    // Postcondition: Return value is the tuple of the first cell of row
+    void count_tiled_blocks(counts_t & table) const;
+    // Precondition: data storage is TILED, table as in count_dense_blocks
+    // Postcondition: table has the value counts of every block, counted in
+    // one sweep over the tiles
+    template<int Ways>
+    void count_ranked_tiled_blocks(counts_t & table) const;
+    // Precondition: same as count_tiled_blocks, data has Ways ways
+    // Postcondition: same as count_tiled_blocks
+    template<int Ways>
+    void get_blocking(Blocking<Ways> & blocking, int way) const;
+    // Precondition: data has Ways ways, way < Ways or way == -1
+    // Postcondition: blocking has the units and clusters of every way, way
+    // left out (its blocks are those of blocking_size(way))
+    friend void count_slab(void * slabs, int slab);
+    template<class C>
+    friend void sweep_signatures(void * sweep, int part);
+    template<class C>
+    friend void sweep_placements(void * sweep, int part);
+    void get_tiled_signatures(std::vector<std::vector<counts_t> > & signatures,
+      int way, const cluster_t & units) const;
+    // Precondition: data storage is TILED, units are units of way
+    // Postcondition: signatures[i] is the signature of units[i] (as in
+    // get_unit_signature), counted in one sweep over the tiles
+    template<int Ways>
+    void get_ranked_tiled_signatures
+    (std::vector<std::vector<counts_t> > & signatures, int way,
+      const cluster_t & units) const;
+    // Precondition: same as get_tiled_signatures, data has Ways ways
+    // Postcondition: same as get_tiled_signatures
   };
 
+  void count_slab(void * slabs, int slab);
+  // Precondition: slabs points to an array of Multiclustering::Slab
+  // Postcondition: blocks of the cells of slab are counted into its table
+  // (task of the thread pool)
+  template<class C>
+  void sweep_signatures(void * sweep, int part);
+  // Precondition: sweep points to a Multiclustering::Sweep with signatures
+  // of counters of C
+  // Postcondition: signatures of the units of part are computed (task of
+  // the thread pool)
+  template<class C>
+  void sweep_placements(void * sweep, int part);
+  // Precondition: sweep points to a Multiclustering::Sweep with signatures
+  // of counters of C, lengths, scores and new_assignments
+  // Postcondition: scores has the costs of the units of part in every
+  // cluster and new_assignments their best clusters (task of the thread
+  // pool)
+  double block_encoding(const counts_t & counts, double types);
+  // Precondition: counts are the value counts of a block, types is the
+  // number of values minus one
+  // Postcondition: Return value is the type encoding (model) plus the data
+  // encoding of the block, as summed by cost()
   double hoffman_coding
-  (const std::vector<int> & counts);
+  (const counts_t & counts);
   // Precondition: counts is the number of times each value appears
   // Postcondition: Return value is Hoffman encoding cost in nats
+  double hoffman_coding(const index_t * counts, size_t size);
+  // Precondition: counts points to the size counts of the values
+  // Postcondition: same as hoffman_coding(counts)
   double hoffman_coding
-  (const std::vector<int> & counts, const std::vector<double> & frequencies);
+  (const counts_t & counts, const std::vector<double> & frequencies);
   // Precondition: counts is the number of times a value appears, frequencies
   // is the frequency of the value appearing relative to block size
   // Postcondition: Return value is Hoffman encoding cost in nats
   double hoffman_coding
-  (const std::vector<int> & unit_counts, const std::vector<int> & block_counts);
+  (const counts_t & unit_counts, const counts_t & block_counts);
   // Precondition: counts is the number of times a value appears, frequencies
   // is the frequency of the value appearing relative to block size
   // Postcondition: Return value is Hoffman encoding cost in nats
-  double hoffman_coding(int count, double frequency);
+  double hoffman_coding(index_t count, double frequency);
   // Precondition: count is the number of occurences of an item, and frequency
   // its frequency relative to the total number of items in a block
   // Postcondition: Return value is the hoffman conding cost in nats
-  double frequency(int count, int total);
+  double frequency(index_t count, index_t total);
   // Precondition: count is the number of occurrences of a type of item, and
   // total is the total number of all types of items
   // Postcondition: Return value is the frequency (> 0) of the item
+
+  // Tables of n ln(n) and ln(n) for the counts met by the cost functions,
+  // indexed by n. They are grown to the largest block total each time the
+  // block table is counted or set and before a way is swept (on the calling
+  // thread, so they are read-only while the threads evaluate costs) and
+  // never shrink. They stop at LOG_TABLE_SIZE entries (16 MB for both):
+  // counts and totals beyond it, met only by blocks of more than a million
+  // cells, call log instead, which gives the same costs.
+  const index_t LOG_TABLE_SIZE = 1 << 20;
+  extern std::vector<double> n_log_n_table;
+  extern std::vector<double> log_table;
+
+  void grow_log_tables(index_t size);
+  // Precondition: none
+  // Postcondition: tables cover the counts up to size (or up to
+  // LOG_TABLE_SIZE - 1 if size is larger)
+
+  inline double n_log_n(index_t n)
+  // Precondition: n >= 0
+  // Postcondition: Return value is n ln(n) (0 for n == 0)
+  // Library facilities used: log
+  {
+    if(n < index_t(n_log_n_table.size())) return n_log_n_table[size_t(n)];
+    return n == 0 ? 0 : n * log(double(n));
+  }
+
+  inline double log_count(index_t n)
+  // Precondition: n > 0
+  // Postcondition: Return value is ln(n)
+  // Library facilities used: log
+  {
+    if(n < index_t(log_table.size())) return log_table[size_t(n)];
+    return log(double(n));
+  }
 }
 
 #endif
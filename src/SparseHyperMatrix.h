@@ -0,0 +1,267 @@
+// FILE: SparseHyperMatrix.h
+// TEMPLATE CLASS PROVIDED: SparseHyperMatrix (part of the namespace rlair_multi_clustering)
+
+#ifndef RLAIR_MULTI_CLUSTERING_SPARSEHYPERMATRIX
+#define RLAIR_MULTI_CLUSTERING_SPARSEHYPERMATRIX
+
+#include <fstream>                  // provides: ostream
+#include <string>                   // provides: string
+#include <vector>                   // provides: vector
+#include <map>                      // provides: map
+#include <utility>                  // provides: pair
+#include <algorithm>                // provides: sort
+#include "Indexer.h"
+#include "Array.h"
+
+namespace rlair_multi_clustering
+{
+  // Stores only the nonzero cells of a hyper-matrix as a list of coordinate
+  // tuples (COO). The nonzeros are kept in lexicographic order and, for each
+  // way, a fiber lists the nonzeros that share a unit of that way, so that
+  // the cells of a unit can be visited without scanning the whole list.
+  // Cells set after compress are appended past the compressed nonzeros and
+  // listed by unit in extra, until enough of them are set to compress
+  // again.
+  template<class T>
+  class SparseHyperMatrix
+  {
+  public:
+    // CONSTRUCTORS and DESTRUCTORS
+    SparseHyperMatrix() {}
+
+    SparseHyperMatrix(const std::vector<int> & dimensions)
+    : dimensions(dimensions) {}
+
+    // MODIFICATION MEMBER FUNCTIONS
+    void insert(const std::vector<int> & tuple, T value)
+    // Precondition: tuple is within range
+    // Postcondition: cell is appended (takes effect after compress)
+    // Library facilities used: assert
+    {
+      assert(tuple.size() == dimensions.size());
+      coordinates.append(tuple.begin(), tuple.end());
+      data.push_back(value);
+    }
+
+    void append(const SparseHyperMatrix & source)
+    // Precondition: source has the same dimensions
+    // Postcondition: cells of source are appended (take effect after
+    // compress, after the cells already inserted)
+    // Library facilities used: none
+    {
+      coordinates.append(source.coordinates.begin(),
+        source.coordinates.end());
+      data.append(source.data.begin(), source.data.end());
+    }
+
+    void set(const std::vector<int> & tuple, T value)
+    // Precondition: tuple is within range and compress has been called
+    // Postcondition: cell has value at once: a stored cell is changed in
+    // place (a zero stays as an entry until the next compress), another one
+    // is appended and listed in pending and extra; the nonzeros are
+    // compressed again once the cells appended since the last compress
+    // exceed an eighth of the compressed ones
+    // Library facilities used: map
+    {
+      size_t entry = find(tuple);
+      if(entry != data.size())
+      {
+        data[entry] = value;
+        return;
+      }
+      if(value == T()) return;
+
+      int ways = int(dimensions.size());
+      if(extra.empty())
+      {
+        extra = std::vector<std::vector<std::vector<size_t> > >(ways);
+        for(int way = 0; way != ways; ++way)
+          extra[way].resize(dimensions[way]);
+      }
+      pending[hyper_index(tuple, dimensions)] = entry;
+      for(int way = 0; way != ways; ++way)
+        extra[way][tuple[way]].push_back(entry);
+      insert(tuple, value);
+      if(8 * (data.size() - compressed()) > compressed()) compress();
+    }
+
+    void compress()
+    // Precondition: none
+    // Postcondition: nonzeros are sorted, duplicates keep the last value
+    // inserted, zeros are dropped, the fibers of every way are built, and
+    // pending and extra are empty
+    // Library facilities used: sort, pair
+    {
+      pending.clear();
+      extra.clear();
+      int ways = int(dimensions.size());
+      size_t cells = data.size();
+
+      // sort by flat index, ties in insertion order
+      std::vector<std::pair<size_t, size_t> > order(cells);
+      for(size_t i = 0; i != cells; ++i)
+      {
+        size_t index = 0;
+        for(int way = 0; way != ways; ++way)
+          index = index * dimensions[way] + coordinates[i * ways + way];
+        order[i] = std::make_pair(index, i);
+      }
+      std::sort(order.begin(), order.end());
+
+      // keep last value of each cell
+      Array<int> sorted_coordinates;
+      Array<T> sorted_data;
+      for(size_t i = 0; i != cells; ++i)
+      {
+        if(i + 1 != cells && order[i + 1].first == order[i].first) continue;
+        size_t j = order[i].second;
+        if(data[j] == T()) continue;
+        sorted_coordinates.append(coordinates.begin() + j * ways,
+          coordinates.begin() + (j + 1) * ways);
+        sorted_data.push_back(data[j]);
+      }
+      coordinates.swap(sorted_coordinates);
+      data.swap(sorted_data);
+
+      // build fibers (counting sort per way keeps lexicographic order)
+      size_t nonzeros = data.size();
+      offsets = std::vector<Array<size_t> >(ways);
+      fibers = std::vector<Array<size_t> >(ways);
+      for(int way = 0; way != ways; ++way)
+      {
+        Array<size_t> & offset = offsets[way];
+        offset = Array<size_t>(dimensions[way] + 1);
+        for(size_t i = 0; i != nonzeros; ++i)
+          ++offset[coordinates[i * ways + way] + 1];
+        for(int unit = 0; unit != dimensions[way]; ++unit)
+          offset[unit + 1] += offset[unit];
+        std::vector<size_t> next(offset.begin(), offset.end() - 1);
+        fibers[way] = Array<size_t>(nonzeros);
+        for(size_t i = 0; i != nonzeros; ++i)
+          fibers[way][next[coordinates[i * ways + way]]++] = i;
+      }
+    }
+
+    // CONSTANT MEMBER FUNCTIONS
+    size_t size() const {return data.size();}
+    // Precondition: none
+    // Postcondition: The return value is the number of nonzero elements
+    // (and of the cells set to zero since the last compress)
+
+    size_t compressed() const {return fibers.empty() ? 0 : fibers[0].size();}
+    // Precondition: none
+    // Postcondition: The return value is the number of nonzeros listed in
+    // the fibers (the first ones)
+
+    size_t bytes() const
+    // Precondition: none
+    // Postcondition: The return value is the memory used by the elements
+    // Library facilities used: none
+    {
+      size_t size = coordinates.size() * sizeof(int) + data.size() * sizeof(T);
+      for(size_t way = 0; way != fibers.size(); ++way)
+        size += (fibers[way].size() + offsets[way].size()) * sizeof(size_t);
+      return size;
+    }
+
+    const int * tuple(size_t nonzero) const
+    // Precondition: nonzero < size()
+    // Postcondition: Return value points to the coordinates of the nonzero
+    {return &coordinates[nonzero * dimensions.size()];}
+
+    size_t find(const std::vector<int> & tuple) const
+    // Precondition: tuple is within range and compress has been called
+    // Postcondition: Return value is the entry of the cell located by tuple,
+    // or size() if it is not stored
+    // Library facilities used: assert, map
+    {
+      assert(tuple.size() == dimensions.size());
+      int ways = int(dimensions.size());
+
+      // binary search the (lexicographically ordered) fiber of first way
+      const Array<size_t> & fiber = fibers[0];
+      size_t low = offsets[0][tuple[0]];
+      size_t high = offsets[0][tuple[0] + 1];
+      while(low < high)
+      {
+        size_t middle = low + (high - low) / 2;
+        const int * cell = this->tuple(fiber[middle]);
+        int way = 1;
+        while(way != ways && cell[way] == tuple[way]) ++way;
+        if(way == ways) return fiber[middle];
+        if(cell[way] < tuple[way]) low = middle + 1;
+        else high = middle;
+      }
+
+      // cells appended since
+      if(pending.empty()) return data.size();
+      std::map<index_t, size_t>::const_iterator entry =
+        pending.find(hyper_index(tuple, dimensions));
+      return entry == pending.end() ? data.size() : entry->second;
+    }
+
+    T operator()(const std::vector<int> & tuple) const
+    // Precondition: tuple is within range and compress has been called
+    // Postcondition: Return value is the element located by tuple
+    // Library facilities used: none
+    {
+      size_t entry = find(tuple);
+      return entry == data.size() ? T() : data[entry];
+    }
+
+    void print_2D_slice
+    (const std::vector<int> & dimension, const std::string & file) const
+    // Precondition: file is the name of output file
+    // Postcondition: matrix slice is printed to file
+    // Library facilities used: none
+    {
+      std::ofstream out(file.c_str());
+      print_2D_slice(dimension, out);
+      out.close();
+    }
+
+    void print_2D_slice
+    (const std::vector<int> & dimension, std::ostream & out) const
+    // Precondition: out is an open output stream
+    // Postcondition: matrix slice is printed to out
+    // Library facilities used: assert
+    {
+      int ways = static_cast<int>(dimensions.size());
+
+      assert(int(dimension.size()) == ways);
+
+      // get row and column ways
+      std::vector<int> plane;
+      for(int way = 0; way != ways; ++way)
+        if(dimension[way] == -1) plane.push_back(way);
+      assert(int(plane.size()) == 2);
+
+      const int ROW = plane[0];
+      const int COL = plane[1];
+
+      // print
+      std::vector<int> tuple(dimension);
+      for(tuple[ROW] = 0; tuple[ROW] != dimensions[ROW]; ++tuple[ROW])
+      {
+        for(tuple[COL] = 0; tuple[COL] != dimensions[COL]; ++tuple[COL])
+          out << operator()(tuple);
+        out << " " << std::endl;
+      }
+    }
+
+    // MEMBER VARIABLES
+    std::vector<int> dimensions;                // size of each way
+    Array<int> coordinates;                     // tuple of each nonzero
+    Array<T> data;                              // value of each nonzero
+    std::vector<Array<size_t> > offsets;        // fiber start of each unit
+    std::vector<Array<size_t> > fibers;         // nonzeros ordered by unit
+    std::map<index_t, size_t> pending;          // entry of each cell (by
+                                                // flat index) appended by
+                                                // set since compress
+    std::vector<std::vector<std::vector<size_t> > > extra; // entries of
+                                                // pending of each unit of
+                                                // each way (empty if none)
+  };
+}
+
+#endif
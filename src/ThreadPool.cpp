@@ -0,0 +1,164 @@
+// FILE: ThreadPool.cpp (part of namespace rlair_multi_clustering)
+// CLASS implemented: ThreadPool (see ThreadPool.h for documentation)
+
+#include <cstddef>                  // provides: NULL
+#include "ThreadPool.h"
+
+using namespace std;
+
+namespace rlair_multi_clustering
+{
+  ThreadPool::ThreadPool()
+  : task(NULL), context(NULL), parts(0), next(0), enlisted(0), running(0),
+    job(0), quit(false)
+  // Library facilities used: pthread_mutex_init, pthread_cond_init
+  {
+#ifndef WIN32
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&wake, NULL);
+    pthread_cond_init(&done, NULL);
+#endif
+  }
+
+  ThreadPool::ThreadPool(const ThreadPool &)
+  : task(NULL), context(NULL), parts(0), next(0), enlisted(0), running(0),
+    job(0), quit(false)
+  // Library facilities used: pthread_mutex_init, pthread_cond_init
+  {
+#ifndef WIN32
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&wake, NULL);
+    pthread_cond_init(&done, NULL);
+#endif
+  }
+
+  ThreadPool::~ThreadPool()
+  // Library facilities used: pthread_mutex_destroy, pthread_cond_destroy
+  {
+    stop();
+#ifndef WIN32
+    pthread_cond_destroy(&done);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+#endif
+  }
+
+  ThreadPool & ThreadPool::operator=(const ThreadPool &)
+  // Library facilities used: none
+  {return *this;}
+
+  void ThreadPool::run(int threads, task_t task, void * context, int parts)
+  // Library facilities used: pthread_mutex_lock, pthread_cond_broadcast,
+  // pthread_cond_wait
+  {
+    if(threads > parts) threads = parts;
+#ifndef WIN32
+    if(threads > 1 && int(workers.size()) < threads - 1)
+    {
+      stop();
+      start(threads - 1);
+    }
+    if(threads > 1 && !workers.empty())
+    {
+      pthread_mutex_lock(&lock);
+      this->task = task;
+      this->context = context;
+      this->parts = parts;
+      next = 0;
+      enlisted = threads - 1;
+      running = int(workers.size());
+      ++job;
+      pthread_cond_broadcast(&wake);
+
+      // share of the caller, then wait for the workers
+      while(next < parts)
+      {
+        int part = next++;
+        pthread_mutex_unlock(&lock);
+        task(context, part);
+        pthread_mutex_lock(&lock);
+      }
+      while(running != 0) pthread_cond_wait(&done, &lock);
+      pthread_mutex_unlock(&lock);
+      return;
+    }
+#endif
+    for(int part = 0; part != parts; ++part) task(context, part);
+  }
+
+  void ThreadPool::start(int workers)
+  // Library facilities used: pthread_create
+  {
+#ifndef WIN32
+    // workers wait for the jobs after the current one
+    this->workers = vector<Worker>(workers);
+    threads = vector<pthread_t>(workers);
+    int started = 0;
+    for(; started != workers; ++started)
+    {
+      Worker worker = {this, started, job};
+      this->workers[started] = worker;
+      if(pthread_create(&threads[started], NULL, pool_worker,
+          &this->workers[started]) != 0)
+        break;
+    }
+    this->workers.resize(started);
+    threads.resize(started);
+#else
+    (void) workers;
+#endif
+  }
+
+  void ThreadPool::stop()
+  // Library facilities used: pthread_join
+  {
+#ifndef WIN32
+    if(threads.empty()) return;
+    pthread_mutex_lock(&lock);
+    quit = true;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+    for(size_t i = 0; i != threads.size(); ++i)
+      pthread_join(threads[i], NULL);
+    quit = false;
+    threads.clear();
+    workers.clear();
+#endif
+  }
+
+  void ThreadPool::work(int id, unsigned seen)
+  // Library facilities used: pthread_mutex_lock, pthread_cond_wait,
+  // pthread_cond_signal
+  {
+#ifndef WIN32
+    pthread_mutex_lock(&lock);
+    while(true)
+    {
+      while(!quit && job == seen) pthread_cond_wait(&wake, &lock);
+      if(quit) break;
+      seen = job;
+      if(id < enlisted)
+        while(next < parts)
+        {
+          int part = next++;
+          pthread_mutex_unlock(&lock);
+          task(context, part);
+          pthread_mutex_lock(&lock);
+        }
+      if(--running == 0) pthread_cond_signal(&done);
+    }
+    pthread_mutex_unlock(&lock);
+#else
+    (void) id;
+    (void) seen;
+#endif
+  }
+
+  void * pool_worker(void * worker)
+  // Library facilities used: none
+  {
+    ThreadPool::Worker & self = *static_cast<ThreadPool::Worker *>(worker);
+    self.pool->work(self.id, self.job);
+    return NULL;
+  }
+}
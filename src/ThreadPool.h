@@ -0,0 +1,84 @@
+// FILE: ThreadPool.h
+// CLASS PROVIDED: ThreadPool (part of the namespace rlair_multi_clustering)
+
+#ifndef RLAIR_MULTI_CLUSTERING_THREADPOOL
+#define RLAIR_MULTI_CLUSTERING_THREADPOOL
+
+#include <vector>                   // provides: vector
+#ifndef WIN32
+#include <pthread.h>                // provides: pthread_t, pthread_mutex_t
+#endif
+
+namespace rlair_multi_clustering
+{
+  // Runs the parts of a job on worker threads that are started by the first
+  // job and wait for the next one, so that sweeps repeated many times (e.g.,
+  // one per way and regroup iteration) do not create threads each time. The
+  // calling thread runs parts too; parts are handed out in order to whichever
+  // thread is free. Without pthreads (WIN32) the parts run in the caller.
+  class ThreadPool
+  {
+  public:
+    typedef void (*task_t)(void * context, int part);
+
+    // CONSTRUCTORS and DESTRUCTOR
+    ThreadPool();
+    ThreadPool(const ThreadPool & source);
+    ~ThreadPool();
+
+    // MODIFICATION MEMBER FUNCTIONS
+    ThreadPool & operator=(const ThreadPool & source);
+    // Precondition: none
+    // Postcondition: *this is unchanged (workers are not shared)
+    void run(int threads, task_t task, void * context, int parts);
+    // Precondition: task may run concurrently for distinct parts
+    // Postcondition: task(context, part) has returned for each part in
+    // [0, parts), run by at most threads threads (the caller included)
+
+    // worker thread of the pool
+    struct Worker
+    {
+      ThreadPool * pool;
+      int id;
+      unsigned job;                   // jobs run before the worker started
+    };
+
+  private:
+    friend void * pool_worker(void * worker);
+
+    void start(int workers);
+    // Precondition: no worker is running
+    // Postcondition: workers threads wait for jobs
+    void stop();
+    // Precondition: no job is running
+    // Postcondition: worker threads have exited
+    void work(int id, unsigned seen);
+    // Precondition: seen jobs were run before worker id started
+    // Postcondition: worker id has run its share of each later job until
+    // stop
+
+    // MEMBER VARIABLES
+#ifndef WIN32
+    pthread_mutex_t lock;             // guards the members below
+    pthread_cond_t wake;              // signals a new job or stop
+    pthread_cond_t done;              // signals the end of a worker's share
+    std::vector<pthread_t> threads;   // worker threads
+#endif
+    std::vector<Worker> workers;      // arguments of the worker threads
+    task_t task;                      // task of current job
+    void * context;                   // argument of task
+    int parts;                        // parts of current job
+    int next;                         // next part to run
+    int enlisted;                     // workers that run parts of the job
+    int running;                      // workers not done with the job
+    unsigned job;                     // number of jobs run (wakes workers)
+    bool quit;                        // workers exit
+  };
+
+  void * pool_worker(void * worker);
+  // Precondition: worker points to a ThreadPool::Worker
+  // Postcondition: worker has run its share of jobs until stop (thread
+  // entry point)
+}
+
+#endif
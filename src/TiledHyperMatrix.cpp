@@ -0,0 +1,324 @@
+// FILE: TiledHyperMatrix.cpp (part of namespace rlair_multi_clustering)
+// CLASS implemented: TiledHyperMatrix (see TiledHyperMatrix.h for documentation)
+
+#include <cstdlib>                  // provides: exit, mkstemp
+#include <cstdio>                   // provides: fopen, fread, fwrite
+#include <iostream>                 // provides: cerr
+#include <algorithm>                // provides: stable_sort, max
+#include <cassert>                  // provides: assert
+#ifndef WIN32
+#include <unistd.h>                 // provides: unlink, close
+#include <sys/types.h>              // provides: off_t
+#endif
+#include "TiledHyperMatrix.h"
+
+using namespace std;
+
+namespace rlair_multi_clustering
+{
+  const size_t TiledHyperMatrix::TILE;
+
+  TiledHyperMatrix::TiledHyperMatrix()
+    : cells(0), binary(false), budget(0), hits(0), misses(0), shared(NULL) {}
+
+  TiledHyperMatrix::TiledHyperMatrix(const vector<int> & dimensions,
+    bool binary, const string & directory, size_t budget)
+    : dimensions(dimensions), cells(1), binary(binary), budget(budget),
+      hits(0), misses(0), shared(NULL)
+  // Library facilities used: mkstemp, fdopen, unlink (tmpfile on WIN32),
+  // fwrite, exit
+  {
+    for(size_t way = 0; way != dimensions.size(); ++way)
+      cells *= dimensions[way];
+    FILE * file = NULL;
+#ifndef WIN32
+    string pattern = directory + "tiles.XXXXXX";
+    vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    int descriptor = mkstemp(&name[0]);
+    if(descriptor != -1)
+    {
+      unlink(&name[0]);
+      file = fdopen(descriptor, "w+b");
+      if(file == NULL) close(descriptor);
+    }
+#else
+    file = tmpfile();
+#endif
+    if(file == NULL)
+    {
+      cerr << "error creating tile file in " << directory << endl;
+      exit(1);
+    }
+    shared = new Shared;
+    shared->file = file;
+    shared->owners = 1;
+
+    // the file holds every tile, zero until written (the last tile is
+    // written, the others are holes where the file system allows)
+    if(cells == 0) return;
+    size_t last = tiles() - 1;
+    vector<cell_t> zeros(tile_bytes(last), 0);
+    seek(last);
+    if(fwrite(&zeros[0], 1, zeros.size(), file) != zeros.size())
+      {cerr << "error writing tile file" << endl; exit(1);}
+  }
+
+  TiledHyperMatrix::TiledHyperMatrix(const TiledHyperMatrix & source)
+    : cells(0), binary(false), budget(0), hits(0), misses(0), shared(NULL)
+  // Library facilities used: none
+  {operator=(source);}
+
+  TiledHyperMatrix::~TiledHyperMatrix()
+  // Library facilities used: none
+  {release();}
+
+  TiledHyperMatrix & TiledHyperMatrix::operator=
+  (const TiledHyperMatrix & source)
+  // Library facilities used: none
+  {
+    if(this == &source) return *this;
+    release();
+    dimensions = source.dimensions;
+    cells = source.cells;
+    binary = source.binary;
+    budget = source.budget;
+    hits = misses = 0;
+    shared = source.shared;
+    if(shared != NULL) ++shared->owners;
+    return *this;
+  }
+
+  bool staged_before(uint64_t first, uint64_t second)
+  // Precondition: first and second are staged cells (flat index << 8 |
+  // value)
+  // Postcondition: Return value is true if the cell of first comes before
+  // the cell of second in flat order
+  // Library facilities used: none
+  {
+    return (first >> 8) < (second >> 8);
+  }
+
+  void TiledHyperMatrix::stage(const vector<int> & tuple, cell_t value)
+  // Library facilities used: max
+  {
+    // the staged cells and the buffer of their stable sort fit in budget
+    vector<uint64_t> & staged = shared->staged;
+    size_t capacity = max(budget / (2 * sizeof(uint64_t)), TILE);
+    if(staged.empty()) staged.reserve(capacity);
+    staged.push_back(uint64_t(index(tuple)) << 8 | value);
+    if(staged.size() == capacity) apply();
+  }
+
+  void TiledHyperMatrix::apply()
+  // Library facilities used: stable_sort, staged_before
+  {
+    if(shared == NULL) return;
+
+    // in flat order (each tile paged in once), ties in the order staged
+    vector<uint64_t> & staged = shared->staged;
+    stable_sort(staged.begin(), staged.end(), staged_before);
+    for(size_t i = 0; i != staged.size(); ++i)
+    {
+      size_t cell = size_t(staged[i] >> 8);
+      put(page(cell / TILE), cell % TILE, cell_t(staged[i] & 0xff));
+    }
+    vector<uint64_t>().swap(staged);
+  }
+
+  void TiledHyperMatrix::set(const vector<int> & tuple, cell_t value)
+  // Library facilities used: none
+  {
+    size_t cell = index(tuple);
+    put(page(cell / TILE), cell % TILE, value);
+  }
+
+  TiledHyperMatrix::cell_t TiledHyperMatrix::operator()
+  (const vector<int> & tuple) const
+  // Library facilities used: none
+  {
+    size_t cell = index(tuple);
+    return get(page(cell / TILE), cell % TILE);
+  }
+
+  size_t TiledHyperMatrix::tiles() const
+  // Library facilities used: none
+  {
+    return (cells + TILE - 1) / TILE;
+  }
+
+  size_t TiledHyperMatrix::tile_size(size_t tile) const
+  // Library facilities used: none
+  {
+    return tile + 1 == tiles() ? cells - tile * TILE : TILE;
+  }
+
+  const TiledHyperMatrix::cell_t * TiledHyperMatrix::tile(size_t tile) const
+  // Library facilities used: none
+  {
+    int slot = page(tile);
+    if(!binary) return &shared->slots[slot][0];
+    vector<cell_t> & cells_of_tile = shared->cells_of_tile;
+    cells_of_tile.resize(TILE);
+    for(size_t cell = 0; cell != tile_size(tile); ++cell)
+      cells_of_tile[cell] = get(slot, cell);
+    return &cells_of_tile[0];
+  }
+
+  void TiledHyperMatrix::flush() const
+  // Library facilities used: fflush
+  {
+    if(shared == NULL) return;
+    for(int slot = 0; slot != int(shared->slots.size()); ++slot)
+      write_back(slot);
+    fflush(shared->file);
+  }
+
+  size_t TiledHyperMatrix::bytes() const
+  // Library facilities used: none
+  {
+    if(shared == NULL) return 0;
+    return (shared->slots.size() * tile_bytes(0) +
+      shared->cells_of_tile.size()) * sizeof(cell_t);
+  }
+
+  void TiledHyperMatrix::print_2D_slice
+  (const vector<int> & dimension, const string & file) const
+  // Library facilities used: ofstream
+  {
+    ofstream out(file.c_str());
+    print_2D_slice(dimension, out);
+    out.close();
+  }
+
+  void TiledHyperMatrix::print_2D_slice
+  (const vector<int> & dimension, ostream & out) const
+  // Library facilities used: assert
+  {
+    int ways = static_cast<int>(dimensions.size());
+
+    assert(int(dimension.size()) == ways);
+
+    // get row and column ways
+    vector<int> plane;
+    for(int way = 0; way != ways; ++way)
+      if(dimension[way] == -1) plane.push_back(way);
+    assert(int(plane.size()) == 2);
+
+    const int ROW = plane[0];
+    const int COL = plane[1];
+
+    // print
+    vector<int> tuple(dimension);
+    for(tuple[ROW] = 0; tuple[ROW] != dimensions[ROW]; ++tuple[ROW])
+    {
+      for(tuple[COL] = 0; tuple[COL] != dimensions[COL]; ++tuple[COL])
+        out << int(operator()(tuple));
+      out << " " << endl;
+    }
+  }
+
+  void TiledHyperMatrix::release()
+  // Library facilities used: fclose
+  {
+    if(shared != NULL && --shared->owners == 0)
+    {
+      fclose(shared->file);
+      delete shared;
+    }
+    shared = NULL;
+  }
+
+  void TiledHyperMatrix::seek(size_t tile) const
+  // Library facilities used: fseeko (_fseeki64 on WIN32), exit
+  {
+#ifndef WIN32
+    bool failed = fseeko(shared->file, off_t(tile) * off_t(tile_bytes(0)),
+      SEEK_SET) != 0;
+#else
+    bool failed = _fseeki64(shared->file, __int64(tile) * tile_bytes(0),
+      SEEK_SET) != 0;
+#endif
+    if(failed) {cerr << "error seeking tile file" << endl; exit(1);}
+  }
+
+  size_t TiledHyperMatrix::tile_bytes(size_t tile) const
+  // Library facilities used: none
+  {
+    return binary ? (tile_size(tile) + 7) / 8 : tile_size(tile);
+  }
+
+  int TiledHyperMatrix::page(size_t tile) const
+  // Library facilities used: map, list, fread, exit
+  {
+    assert(tile < tiles());
+    vector<vector<cell_t> > & slots = shared->slots;
+    vector<size_t> & slot_tiles = shared->slot_tiles;
+    map<size_t, int> & resident = shared->resident;
+    list<int> & recent = shared->recent;
+    vector<list<int>::iterator> & positions = shared->positions;
+
+    // resident tile
+    map<size_t, int>::const_iterator found = resident.find(tile);
+    if(found != resident.end())
+    {
+      ++hits;
+      recent.splice(recent.begin(), recent, positions[found->second]);
+      return found->second;
+    }
+    ++misses;
+
+    // take a free slot, or evict the least recently used tile
+    int slot;
+    size_t capacity =
+      budget / tile_bytes(0) > 1 ? budget / tile_bytes(0) : 1;
+    if(slots.size() < capacity)
+    {
+      slot = int(slots.size());
+      slots.push_back(vector<cell_t>(tile_bytes(0)));
+      slot_tiles.push_back(tile);
+      shared->dirty.push_back(false);
+      recent.push_front(slot);
+      positions.push_back(recent.begin());
+    }
+    else
+    {
+      slot = recent.back();
+      write_back(slot);
+      resident.erase(slot_tiles[slot]);
+      recent.splice(recent.begin(), recent, positions[slot]);
+    }
+    slot_tiles[slot] = tile;
+    shared->dirty[slot] = false;
+    resident[tile] = slot;
+
+    // read tile
+    seek(tile);
+    if(fread(&slots[slot][0], 1, tile_bytes(tile), shared->file) !=
+      tile_bytes(tile))
+      {cerr << "error reading tile file" << endl; exit(1);}
+    return slot;
+  }
+
+  void TiledHyperMatrix::write_back(int slot) const
+  // Library facilities used: fwrite, exit
+  {
+    if(!shared->dirty[slot]) return;
+    size_t tile = shared->slot_tiles[slot];
+    seek(tile);
+    if(fwrite(&shared->slots[slot][0], 1, tile_bytes(tile), shared->file) !=
+      tile_bytes(tile))
+      {cerr << "error writing tile file" << endl; exit(1);}
+    shared->dirty[slot] = false;
+  }
+
+  size_t TiledHyperMatrix::index(const vector<int> & tuple) const
+  // Library facilities used: assert
+  {
+    assert(tuple.size() == dimensions.size());
+    size_t flat = 0;
+    for(size_t way = 0; way != dimensions.size(); ++way)
+      flat = flat * dimensions[way] + tuple[way];
+    return flat;
+  }
+}
@@ -0,0 +1,181 @@
+// FILE: TiledHyperMatrix.h
+// CLASS PROVIDED: TiledHyperMatrix (part of the namespace rlair_multi_clustering)
+
+#ifndef RLAIR_MULTI_CLUSTERING_TILEDHYPERMATRIX
+#define RLAIR_MULTI_CLUSTERING_TILEDHYPERMATRIX
+
+#include <fstream>                  // provides: ostream
+#include <cstdio>                   // provides: FILE
+#include <string>                   // provides: string
+#include <vector>                   // provides: vector
+#include <list>                     // provides: list
+#include <map>                      // provides: map
+#include <cstddef>                  // provides: size_t
+#include <stdint.h>                 // provides: uint64_t
+
+namespace rlair_multi_clustering
+{
+  // Stores a hyper-matrix out of core: the cells (one byte each, or one bit
+  // each for a binary matrix, in flat order) are split into fixed-size tiles
+  // kept in a file, and tiles are paged in on demand through a
+  // least-recently-used cache whose size is bounded by a memory budget.
+  // Sweeps that visit the tiles in order read each tile once. Cells are
+  // loaded by staging them in a buffer bounded by the budget, applied in
+  // flat order (one visit of each tile touched) whenever it fills. The tile
+  // file is a temporary file that is unlinked as soon as it is created (it
+  // is removed when its last user closes it, even if the program is
+  // killed). Copies share the tile file together with its cache and staged
+  // cells, so a cell set through one copy is seen by all of them.
+  class TiledHyperMatrix
+  {
+  public:
+    typedef unsigned char cell_t;
+
+    static const size_t TILE = 1 << 16; // cells per tile
+
+    // CONSTRUCTORS and DESTRUCTORS
+    TiledHyperMatrix();
+    TiledHyperMatrix(const std::vector<int> & dimensions, bool binary,
+      const std::string & directory, size_t budget);
+    // Precondition: directory is empty (the current directory) or ends with
+    // a separator, and is writable
+    // Postcondition: matrix of zeros whose tile file is created in directory;
+    // cells are stored as bits if binary (their values are then 0 or 1)
+    TiledHyperMatrix(const TiledHyperMatrix & source);
+    ~TiledHyperMatrix();
+
+    // MODIFICATION MEMBER FUNCTIONS
+    TiledHyperMatrix & operator=(const TiledHyperMatrix & source);
+    // Precondition: none
+    // Postcondition: *this shares the tile file, cache and staged cells of
+    // source
+    void stage(const std::vector<int> & tuple, cell_t value);
+    // Precondition: tuple is within range
+    // Postcondition: element located by tuple will be value once the staged
+    // cells are applied, which is done when budget bytes of them (sort
+    // buffer included, at least TILE cells) are staged
+    void apply();
+    // Precondition: none
+    // Postcondition: staged cells are set in the order they were staged
+    // (later ones override earlier ones), each tile they touch paged in
+    // once, and none is staged
+    void set(const std::vector<int> & tuple, cell_t value);
+    // Precondition: tuple is within range
+    // Postcondition: element located by tuple is value (written back to the
+    // file when its tile is evicted or flushed)
+
+    // CONSTANT MEMBER FUNCTIONS
+    cell_t operator()(const std::vector<int> & tuple) const;
+    // Precondition: tuple is within range
+    // Postcondition: Return value is the element located by tuple
+    size_t tiles() const;
+    // Precondition: none
+    // Postcondition: Return value is the number of tiles
+    size_t tile_size(size_t tile) const;
+    // Precondition: tile < tiles()
+    // Postcondition: Return value is the number of cells in tile
+    const cell_t * tile(size_t tile) const;
+    // Precondition: tile < tiles()
+    // Postcondition: Return value points to the cells of tile (one byte
+    // each), valid until the next access to a cell or tile
+    void flush() const;
+    // Precondition: none
+    // Postcondition: modified tiles have been written to the file
+    size_t bytes() const;
+    // Precondition: none
+    // Postcondition: Return value is the memory used by resident tiles
+    void print_2D_slice
+    (const std::vector<int> & dimension, const std::string & file) const;
+    void print_2D_slice
+    (const std::vector<int> & dimension, std::ostream & out) const;
+
+    // MEMBER VARIABLES
+    std::vector<int> dimensions;      // size of each way
+    size_t cells;                     // number of cells
+    bool binary;                      // cells stored as bits
+    size_t budget;                    // bytes of resident tiles
+    mutable size_t hits;              // tile accesses found in cache
+    mutable size_t misses;            // tile accesses read from file
+
+  private:
+    // tile file and what is shared with it by the copies of a matrix
+    struct Shared
+    {
+      std::FILE * file;                           // tile file
+      int owners;                                 // matrices sharing file
+      std::vector<cell_t> cells_of_tile;          // tile decoded by tile
+                                                  // (binary)
+      std::vector<uint64_t> staged;               // flat index << 8 | value
+                                                  // of the cells staged
+      std::vector<std::vector<cell_t> > slots;    // resident tiles
+      std::vector<size_t> slot_tiles;             // tile held by each slot
+      std::vector<bool> dirty;                    // slot modified
+      std::map<size_t, int> resident;             // slot of each tile
+      std::list<int> recent;                      // slots, most recent
+                                                  // first
+      std::vector<std::list<int>::iterator> positions; // slot in recent
+    };
+
+    Shared * shared;                              // tile file and cache, or
+                                                  // NULL
+
+    // UTILITY MEMBER FUNCTIONS
+    void release();
+    // Precondition: none
+    // Postcondition: *this no longer shares the tile file (closed by its
+    // last owner)
+    void seek(size_t tile) const;
+    // Precondition: shared is not NULL, tile < tiles()
+    // Postcondition: file is positioned at the start of tile
+    size_t tile_bytes(size_t tile) const;
+    // Precondition: tile < tiles()
+    // Postcondition: Return value is the number of bytes that store tile
+    cell_t get(int slot, size_t cell) const
+    // Precondition: slot holds a tile, cell < TILE
+    // Postcondition: Return value is the value of cell of the tile of slot
+    // Library facilities used: none
+    {
+      const std::vector<cell_t> & tile = shared->slots[slot];
+      if(!binary) return tile[cell];
+      return cell_t((tile[cell / 8] >> (cell % 8)) & 1);
+    }
+    void put(int slot, size_t cell, cell_t value)
+    // Precondition: slot holds a tile, cell < TILE
+    // Postcondition: cell of the tile of slot is value (0 or 1 if binary),
+    // and the slot is dirty
+    // Library facilities used: none
+    {
+      std::vector<cell_t> & tile = shared->slots[slot];
+      if(!binary) tile[cell] = value;
+      else if(value != 0) tile[cell / 8] |= cell_t(1 << (cell % 8));
+      else tile[cell / 8] &= cell_t(~(1 << (cell % 8)));
+      shared->dirty[slot] = true;
+    }
+    int page(size_t tile) const;
+    // Precondition: tile < tiles()
+    // Postcondition: tile is resident and most recently used; Return value
+    // is its slot
+    void write_back(int slot) const;
+    // Precondition: slot holds a tile
+    // Postcondition: tile of slot is written to file if it was modified
+    size_t index(const std::vector<int> & tuple) const;
+    // Precondition: tuple is within range
+    // Postcondition: Return value is the flat index of tuple
+  };
+
+  inline void next_tuple
+  (std::vector<int> & tuple, const std::vector<int> & dimensions)
+  // Precondition: tuple is within range of dimensions
+  // Postcondition: tuple is the next tuple in flat (last way fastest) order,
+  // wrapping around to zero after the last one
+  // Library facilities used: none
+  {
+    for(int way = int(tuple.size()) - 1; way >= 0; --way)
+    {
+      if(++tuple[way] != dimensions[way]) return;
+      tuple[way] = 0;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,330 @@
+// FILE: cache.cpp (part of namespace rlair_multi_clustering)
+// CLASS implemented: Data, binary input cache (see Data.h for documentation)
+
+#include <cstdio>                   // provides: rename, remove
+#include <cstring>                  // provides: memcmp, memcpy
+#include <fstream>                  // provides: ofstream
+#include <sys/types.h>
+#include <sys/stat.h>               // provides: stat (_stat on WIN32)
+#include <stdint.h>                 // provides: uint64_t
+#include "Data.h"
+
+using namespace std;
+
+namespace rlair_multi_clustering
+{
+  // Cache file layout (native byte order, vectors prefixed by their length):
+  //   magic, checksum of the rest of the file but the matrix payload,
+  //   size and modification time (nanoseconds) of the data and labels
+  //   files,
+  //   storage, layout of the DENSE cells, values, mode sizes, way-mode
+  //   map, way sizes,
+  //   matrix payload of the storage backend (each array starting on a
+  //   multiple of PAYLOAD_ALIGNMENT bytes, so that it is used in place),
+  //   first label of each way, offset of each label in the labels file
+  //   (the labels themselves are read from that file when first needed)
+  const char CACHE_MAGIC[8] = {'M', 'C', 'C', 'A', 'C', 'H', 'E', '8'};
+  const size_t CACHE_HEADER = sizeof(CACHE_MAGIC) + sizeof(uint64_t);
+  const size_t PAYLOAD_ALIGNMENT = 8;
+
+  uint64_t checksum(uint64_t hash, const char * bytes, size_t size)
+  // Precondition: bytes points to size readable bytes
+  // Postcondition: Return value is hash, an FNV-1a style hash of the bytes
+  // hashed before, extended with the bytes
+  // Library facilities used: memcpy
+  {
+    const uint64_t prime = 1099511628211UL;
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+      uint64_t word;
+      memcpy(&word, bytes + i, sizeof(word));
+      hash = (hash ^ word) * prime;
+    }
+    for(; i != size; ++i) hash = (hash ^ uint64_t(bytes[i])) * prime;
+    return hash;
+  }
+
+  const uint64_t CHECKSUM_BASIS = 14695981039346656037UL;
+
+  bool stamp(const string & pathname, uint64_t & size, uint64_t & mtime)
+  // Precondition: none
+  // Postcondition: size and mtime are those of the file, mtime in
+  // nanoseconds (so that a rewrite within the same second is seen where the
+  // file system keeps them; whole seconds on WIN32); Return value is false
+  // if the file does not exist
+  // Library facilities used: stat (_stat on WIN32)
+  {
+#ifndef WIN32
+    struct stat status;
+    if(stat(pathname.c_str(), &status) == -1) return false;
+    size = uint64_t(status.st_size);
+    mtime = uint64_t(status.st_mtim.tv_sec) * 1000000000 +
+      uint64_t(status.st_mtim.tv_nsec);
+#else
+    struct _stat status;
+    if(_stat(pathname.c_str(), &status) == -1) return false;
+    size = uint64_t(status.st_size);
+    mtime = uint64_t(status.st_mtime) * 1000000000;
+#endif
+    return true;
+  }
+
+  // Writes the cache file, hashing all but the payload
+  class CacheWriter
+  {
+  public:
+    CacheWriter(const string & pathname)
+    : out(pathname.c_str(), ios::out | ios::binary), sum(CHECKSUM_BASIS) {}
+
+    void write(const char * bytes, size_t size, bool hashed)
+    {
+      out.write(bytes, size);
+      if(hashed) sum = checksum(sum, bytes, size);
+    }
+
+    template<class U> void put(const U & value)
+    {write(reinterpret_cast<const char *>(&value), sizeof(U), true);}
+
+    template<class U> void put(const vector<U> & values)
+    {
+      put(uint64_t(values.size()));
+      if(!values.empty())
+        write(reinterpret_cast<const char *>(&values[0]),
+          values.size() * sizeof(U), true);
+    }
+
+    template<class U> void put_payload(const Array<U> & values)
+    {
+      put(uint64_t(values.size()));
+      const char padding[PAYLOAD_ALIGNMENT] = {0};
+      size_t at = size_t(out.tellp());
+      write(padding, (PAYLOAD_ALIGNMENT - at % PAYLOAD_ALIGNMENT) %
+        PAYLOAD_ALIGNMENT, false);
+      if(!values.empty())
+        write(reinterpret_cast<const char *>(values.begin()),
+          values.size() * sizeof(U), false);
+    }
+
+    ofstream out;
+    uint64_t sum;                     // checksum of all but the payload
+  };
+
+  // Reads the cache file mapped at file, hashing all but the payload
+  class CacheReader
+  {
+  public:
+    CacheReader(char * file, char * p, char * end)
+    : file(file), p(p), end(end), sum(CHECKSUM_BASIS) {}
+
+    template<class U> bool get(U & value)
+    {
+      if(size_t(end - p) < sizeof(U)) return false;
+      memcpy(&value, p, sizeof(U));
+      sum = checksum(sum, p, sizeof(U));
+      p += sizeof(U);
+      return true;
+    }
+
+    template<class U> bool get(vector<U> & values)
+    {
+      uint64_t size;
+      if(!get(size) || size > size_t(end - p) / sizeof(U)) return false;
+      values.resize(size_t(size));
+      if(size) memcpy(&values[0], p, size_t(size) * sizeof(U));
+      sum = checksum(sum, p, size_t(size) * sizeof(U));
+      p += size_t(size) * sizeof(U);
+      return true;
+    }
+
+    template<class U> bool get_payload(Array<U> & values)
+    // the payload is viewed in place, not copied
+    {
+      uint64_t size;
+      if(!get(size)) return false;
+      size_t at = size_t(p - file);
+      size_t padding = (PAYLOAD_ALIGNMENT - at % PAYLOAD_ALIGNMENT) %
+        PAYLOAD_ALIGNMENT;
+      if(padding > size_t(end - p)) return false;
+      p += padding;
+      if(size > size_t(end - p) / sizeof(U)) return false;
+      values.view(reinterpret_cast<U *>(p), size_t(size));
+      p += size_t(size) * sizeof(U);
+      return true;
+    }
+
+    char * file;
+    char * p;
+    char * end;
+    uint64_t sum;                     // checksum of all but the payload
+  };
+
+  string Data::cache_pathname() const
+  // Library facilities used: none
+  {
+    return dir + data_file + ".cache";
+  }
+
+  bool Data::load_cache()
+  // Library facilities used: map_file, checksum, stamp
+  {
+    // stamps of input files
+    uint64_t stamps[4];
+    if(!stamp(dir + data_file, stamps[0], stamps[1])) return false;
+    if(!stamp(dir + labels_file, stamps[2], stamps[3])) return false;
+
+    // map cache copy-on-write (the matrix views the payload in place and
+    // may change it) and check the header
+    size_t size = 0;
+    char * file = const_cast<char *>(map_file(cache_pathname(), size, true));
+    if(file == NULL) return false;
+    bool valid = size >= CACHE_HEADER &&
+      memcmp(file, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0;
+    uint64_t sum = 0;
+    if(valid) memcpy(&sum, file + sizeof(CACHE_MAGIC), sizeof(sum));
+
+    // check that the cache was built from the current input files
+    CacheReader in(file, file + CACHE_HEADER, file + size);
+    for(int i = 0; valid && i != 4; ++i)
+    {
+      uint64_t value;
+      valid = in.get(value) && value == stamps[i];
+    }
+
+    // check storage: DENSE binary data is stored as BINARY (unless its
+    // cells are BLOCKED), and DENSE cells in the layout asked for
+    int stored = -1;
+    int arranged = -1;
+    valid = valid && in.get(stored) && in.get(arranged) && in.get(values);
+    valid = valid && arranged == layout && (stored == storage ||
+      (storage == DENSE && stored == BINARY && values == 2));
+
+    // header
+    vector<int> dimensions;
+    valid = valid && in.get(mode_dimensions) && in.get(way_modes) &&
+      in.get(dimensions);
+
+    // matrix
+    if(valid)
+    {
+      storage = storage_t(stored);
+      if(storage == SPARSE)
+      {
+        int ways = int(dimensions.size());
+        sparse = SparseHyperMatrix<T>(dimensions);
+        sparse.offsets = vector<Array<size_t> >(ways);
+        sparse.fibers = vector<Array<size_t> >(ways);
+        valid = in.get_payload(sparse.coordinates) &&
+          in.get_payload(sparse.data);
+        for(int way = 0; valid && way != ways; ++way)
+          valid = in.get_payload(sparse.offsets[way]) &&
+            in.get_payload(sparse.fibers[way]);
+      }
+      else if(storage == BINARY)
+      {
+        binary = BinaryHyperMatrix(dimensions);
+        size_t words = binary.data.size();
+        valid = in.get_payload(binary.data) && binary.data.size() == words;
+      }
+      else
+      {
+        matrix.reshape(dimensions, layout);
+        size_t cells = matrix.size();
+        valid = in.get_payload(matrix.data) && matrix.size() == cells;
+      }
+    }
+
+    // labels
+    vector<size_t> first;
+    vector<size_t> offsets;
+    valid = valid && in.get(first) && in.get(offsets);
+    valid = valid && first.size() == dimensions.size() + 1 &&
+      first[0] == 0 && !offsets.empty() && first.back() + 1 == offsets.size() &&
+      offsets.back() <= stamps[2];
+    for(size_t way = 0; valid && way != dimensions.size(); ++way)
+      valid = first[way + 1] - first[way] == size_t(dimensions[way]);
+
+    // integrity: all but the payload is hashed, and nothing follows
+    valid = valid && in.sum == sum && in.p == in.end;
+    if(!valid)
+    {
+      matrix = HyperMatrix<T>();
+      sparse = SparseHyperMatrix<T>();
+      binary = BinaryHyperMatrix();
+      unmap_file(file, size);
+      return false;
+    }
+
+    labels.open(dir + labels_file, dimensions);
+    labels.assign(first, offsets);
+    mapped = file;
+    mapped_size = size;
+    bytes = size;
+    return true;
+  }
+
+  void Data::unmap_cache()
+  // Library facilities used: unmap_file
+  {
+    if(mapped == NULL) return;
+    if(matrix.data.viewed()) matrix = HyperMatrix<T>();
+    if(sparse.data.viewed() || sparse.coordinates.viewed())
+      sparse = SparseHyperMatrix<T>();
+    if(binary.data.viewed()) binary = BinaryHyperMatrix();
+    unmap_file(mapped, mapped_size);
+    mapped = NULL;
+    mapped_size = 0;
+  }
+
+  void Data::save_cache() const
+  // Library facilities used: ofstream, rename, checksum, stamp
+  {
+    uint64_t stamps[4];
+    if(!stamp(dir + data_file, stamps[0], stamps[1])) return;
+    if(!stamp(dir + labels_file, stamps[2], stamps[3])) return;
+
+    // write to temporary file, renamed when complete
+    string pathname = cache_pathname();
+    string temporary = pathname + ".tmp";
+    CacheWriter out(temporary);
+    if(out.out.fail())
+    {cerr << "warning: cannot write cache " << pathname << endl; return;}
+
+    // header (checksum is filled in below)
+    out.out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    out.out.write(reinterpret_cast<const char *>(&out.sum), sizeof(out.sum));
+    for(int i = 0; i != 4; ++i) out.put(stamps[i]);
+    out.put(int(storage));
+    out.put(int(layout));
+    out.put(values);
+    out.put(mode_dimensions);
+    out.put(way_modes);
+    out.put(dimensions());
+
+    // matrix
+    if(storage == SPARSE)
+    {
+      out.put_payload(sparse.coordinates);
+      out.put_payload(sparse.data);
+      for(size_t way = 0; way != sparse.fibers.size(); ++way)
+      {
+        out.put_payload(sparse.offsets[way]);
+        out.put_payload(sparse.fibers[way]);
+      }
+    }
+    else if(storage == BINARY) out.put_payload(binary.data);
+    else out.put_payload(matrix.data);
+
+    // labels
+    labels.index();
+    out.put(labels.first);
+    out.put(labels.offsets);
+
+    // checksum of all but the header and the payload
+    out.out.seekp(sizeof(CACHE_MAGIC));
+    out.out.write(reinterpret_cast<const char *>(&out.sum), sizeof(out.sum));
+    out.out.close();
+    if(out.out.fail() || rename(temporary.c_str(), pathname.c_str()) != 0)
+      remove(temporary.c_str());
+  }
+}
@@ -1,4 +1,5 @@
 #include <cmath>                // provides: log
+#include <algorithm>            // provides: min, max, copy
 #include "Multiclustering.h"
 
 using namespace std;
@@ -7,9 +8,29 @@ namespace rlair_multi_clustering
 {
   double Multiclustering::cost()
   // Library facilities used: none
-  {return model_encoding_cost() + data_encoding_cost();}
+  {evaluate_costs(); return model_cost + data_cost;}
 
   double Multiclustering::model_encoding_cost()
+  // Library facilities used: none
+  {evaluate_costs(); return model_cost;}
+
+  double Multiclustering::data_encoding_cost()
+  // Library facilities used: none
+  {evaluate_costs(); return data_cost;}
+
+  void Multiclustering::evaluate_costs()
+  // Library facilities used: none
+  // costs change only with clusterings and block counts, which invalidate
+  // them (make_multiclustering, set_way_signatures, move_unit, ingest)
+  {
+    if(costed) {++options->statistics.cost_hits; return;}
+    ++options->statistics.cost_misses;
+    model_cost = model_encoding();
+    data_cost = data_encoding();
+    costed = true;
+  }
+
+  double Multiclustering::model_encoding() const
   // Library facilities used: log
   {
     // (1) send data matrix dimensions (e.g., M and N) using
@@ -25,41 +46,176 @@ namespace rlair_multi_clustering
     double assignment_encoding = 0;
     for(int way = 0; way != ways; ++way)
       assignment_encoding += 
-      data->matrix.dimensions[way] * log(double(clusterings[way].size()));
+      data->dimensions()[way] * log(double(clusterings[way].size()));
 
     // (3) cost of encoding the type of each block
     // type := distribution of values in block (send number of 1s in blocks)
     // cost per block := (#values - 1) * lg(block_size + 1)
     // NOTE: can make this encoding shorter
+    // (block sizes are the sums of the block counts)
+    if(!counted) count_blocks();
     double type_encoding = 0;
     size_t values = data->values - 1;
-    Indexer::mask_t mask(ways);
-    Indexer::dimensions_t dimensions = blocking_dimensions();
-    Indexer indexer(dimensions, mask);
-    while(!indexer.end())
+    for(size_t block = 0; block != block_table.size(); ++block)
     {
-      int size = block_size(indexer.get_tuple());
+      index_t size = 0;
+      for(size_t v = 0; v != block_table[block].size(); ++v)
+        size += block_table[block][v];
       type_encoding += values * log(double(size) + 1);
-      indexer.forward();
     }
 
     // description complexity cost
     return assignment_encoding + type_encoding;
   }
 
-  double Multiclustering::data_encoding_cost()
-  // Library facilities used: log
+  double Multiclustering::data_encoding() const
+  // Library facilities used: none
   {
+    if(!counted) count_blocks();
     double data_encoding = 0;
-    Indexer::mask_t mask(data->ways());
+    for(size_t block = 0; block != block_table.size(); ++block)
+      data_encoding += hoffman_coding(block_table[block]);
+    return data_encoding;
+  }
+
+  void Multiclustering::count_blocks() const
+  // Library facilities used: ThreadPool, max, grow_log_tables
+  {
+    int values = data->values;
+    int blocks = blocking_size();
+    int ways = data->ways();
+
+    // items are rows of the matrix, layers of tiles along the first way
+    // (BLOCKED layout), nonzeros (SPARSE) or tiles (TILED)
+    index_t items = 1;
+    if(data->storage == Data::SPARSE) items = index_t(data->sparse.size());
+    else if(data->storage != Data::TILED)
+      for(int way = 0; way + 1 < ways; ++way) items *= data->dimensions()[way];
+    index_t cells = items;
+    if(data->storage != Data::SPARSE && data->storage != Data::TILED)
+      cells *= data->dimensions()[ways - 1];
+    if(data->storage == Data::DENSE &&
+      data->matrix.layout == HyperMatrix<Data::T>::BLOCKED)
+    {
+      int span = data->matrix.spans[0];
+      items = (data->dimensions()[0] + span - 1) / span;
+    }
+
+    // one slab per thread, each counted into a private table (tiles share
+    // the cache of the tiled matrix, so they are counted by one thread)
+    int slabs = options->threads < 1 ? 1 : options->threads;
+    if(cells / slabs < SLAB) slabs = int(cells / SLAB) + 1;
+    if(data->storage == Data::TILED || slabs > items) slabs = 1;
+    vector<Slab> parts(slabs);
+    for(int i = 0; i != slabs; ++i)
+    {
+      parts[i].owner = this;
+      parts[i].begin = items / slabs * i;
+      parts[i].end = i == slabs - 1 ? items : items / slabs * (i + 1);
+      parts[i].table = counts_t(size_t(blocks) * values);
+    }
+    options->pool.run(slabs, count_slab, &parts[0], slabs);
+
+    // merge the tables of the slabs
+    counts_t & table = parts[0].table;
+    for(int i = 1; i < slabs; ++i)
+      for(size_t j = 0; j != table.size(); ++j) table[j] += parts[i].table[j];
+
+    // zeros of sparse and binary storage are the rest of each block
+    bool zeros = data->storage == Data::SPARSE ||
+      data->storage == Data::BINARY;
+    block_table = vector<counts_t>(blocks);
+    Indexer::mask_t mask(ways);
     Indexer::dimensions_t dimensions = blocking_dimensions();
     Indexer indexer(dimensions, mask);
-    while(!indexer.end())
+    index_t largest = 0;
+    for(int block = 0; block != blocks; ++block, indexer.forward())
     {
-      data_encoding += block_cost(indexer.get_tuple());
-      indexer.forward();
+      counts_t::const_iterator first = table.begin() + block * values;
+      block_table[block].assign(first, first + values);
+      index_t size = block_size(indexer.get_tuple());
+      largest = max(largest, size);
+      if(!zeros) continue;
+      counts_t & counts = block_table[block];
+      counts[0] = size;
+      for(int v = 1; v != values; ++v) counts[0] -= counts[v];
     }
-    return data_encoding;
+    grow_log_tables(largest);
+    counted = true;
+  }
+
+  void count_slab(void * slabs, int slab)
+  // Library facilities used: none
+  {
+    Multiclustering::Slab & part =
+      static_cast<Multiclustering::Slab *>(slabs)[slab];
+    const Multiclustering & owner = *part.owner;
+    switch(owner.data->storage)
+    {
+      case Data::TILED: owner.count_tiled_blocks(part.table); break;
+      case Data::SPARSE:
+        owner.count_sparse_blocks(part.table, part.begin, part.end); break;
+      case Data::BINARY:
+        owner.count_binary_blocks(part.table, part.begin, part.end); break;
+      default: owner.count_dense_blocks(part.table, part.begin, part.end);
+    }
+  }
+
+  double Multiclustering::move_cost(int way, int unit, int new_cluster)
+  // Library facilities used: find
+  {
+    int old_cluster = assignments[way][unit];
+    const cluster_t & members = clusterings[way][old_cluster];
+    int index =
+      int(find(members.begin(), members.end(), unit) - members.begin());
+    vector<counts_t> signature
+      (blocking_size(way), counts_t(data->values));
+    get_unit_signature(signature, way, old_cluster, index);
+    return move_cost(way, unit, new_cluster, signature);
+  }
+
+  double Multiclustering::move_cost(int way, int unit, int new_cluster,
+    const vector<counts_t> & signature) const
+  // Library facilities used: log
+  // only the blocks of the old and new clusters change: their type
+  // encoding (model) and their data encoding; the assignment encoding
+  // changes only if the old cluster is emptied
+  {
+    int old_cluster = assignments[way][unit];
+    if(new_cluster == old_cluster) return 0;
+    if(!counted) count_blocks();
+
+    int values = data->values;
+    double types = values - 1;
+    counts_t from(values);
+    counts_t to(values);
+    double delta = 0;
+    for(int b = 0; b != int(signature.size()); ++b)
+    {
+      const counts_t & old_from = block_table[block_index(way, old_cluster, b)];
+      const counts_t & old_to = block_table[block_index(way, new_cluster, b)];
+      for(int v = 0; v != values; ++v)
+      {
+        from[v] = old_from[v] - signature[b][v];
+        to[v] = old_to[v] + signature[b][v];
+      }
+      delta += block_encoding(from, types) + block_encoding(to, types) -
+        block_encoding(old_from, types) - block_encoding(old_to, types);
+    }
+
+    int clusters = int(clusterings[way].size());
+    if(clusterings[way][old_cluster].size() == 1)
+      delta += data->dimensions()[way] *
+        (log(double(clusters - 1)) - log(double(clusters)));
+    return delta;
+  }
+
+  double block_encoding(const counts_t & counts, double types)
+  // Library facilities used: log
+  {
+    index_t size = 0;
+    for(size_t v = 0; v != counts.size(); ++v) size += counts[v];
+    return types * log(double(size) + 1) + hoffman_coding(counts);
   }
 
   double Multiclustering::block_cost(const Indexer::tuple_t & tuple) const
@@ -67,14 +223,14 @@ namespace rlair_multi_clustering
   {
     counts_t block_counts;
     get_block_counts(block_counts, tuple);
-    return hoffman_coding(block_counts, block_frequencies(tuple));
+    return hoffman_coding(block_counts);
   }
 
   frequencies_t Multiclustering::block_frequencies
   (const Indexer::tuple_t & tuple) const
   // Library facilities used: none
   {
-    int total = block_size(tuple);
+    index_t total = block_size(tuple);
     counts_t value_counts;
     get_block_counts(value_counts, tuple);
     frequencies_t value_frequencies(data->values);
@@ -87,33 +243,302 @@ namespace rlair_multi_clustering
   (counts_t & counts, const Indexer::tuple_t & tuple) const
   // Library facilities used: none
   {
-    counts = counts_t(data->values);
-    Indexer::indexes_t indexes(data->ways());
+    if(!counted) count_blocks();
+    int index = 0;
     for(int way = 0; way != data->ways(); ++way)
-      indexes[way] = clusterings[way][tuple[way]];
-    Indexer::mask_t mask(data->ways());
-    Indexer indexer(indexes, mask);
-    while(!indexer.end())
+      index = index * int(clusterings[way].size()) + tuple[way];
+    counts = block_table[index];
+  }
+
+  void Multiclustering::get_way_signatures
+  (counts_t & signatures, int way) const
+  // Library facilities used: copy
+  {
+    if(!counted) count_blocks();
+    int values = data->values;
+    int clusters = int(clusterings[way].size());
+    int blocks = blocking_size(way);
+    signatures.resize(size_t(clusters) * blocks * values);
+    for(int c = 0; c != clusters; ++c)
+      for(int b = 0; b != blocks; ++b)
+      {
+        const counts_t & counts = block_table[block_index(way, c, b)];
+        std::copy(counts.begin(), counts.end(),
+          signatures.begin() + (c * blocks + b) * values);
+      }
+  }
+
+  void Multiclustering::set_way_signatures
+  (int way, const index_t * signatures)
+  // Library facilities used: max, grow_log_tables
+  {
+    int values = data->values;
+    int clusters = int(clusterings[way].size());
+    int blocks = blocking_size(way);
+    block_table = vector<counts_t>(blocking_size());
+    index_t largest = 0;
+    for(int c = 0; c != clusters; ++c)
+      for(int b = 0; b != blocks; ++b)
+      {
+        const index_t * counts = signatures + (c * blocks + b) * values;
+        block_table[block_index(way, c, b)].assign(counts, counts + values);
+        index_t total = 0;
+        for(int v = 0; v != values; ++v) total += counts[v];
+        largest = max(largest, total);
+      }
+    grow_log_tables(largest);
+    counted = true;
+    costed = false;
+  }
+
+  void Multiclustering::count_dense_blocks
+  (counts_t & table, index_t begin, index_t end) const
+  // Library facilities used: min, TileWalker
+  {
+    const HyperMatrix<Data::T> & matrix = data->matrix;
+    int ways = data->ways();
+    int last = ways - 1;
+    int values = data->values;
+    const vector<int> & dimensions = data->dimensions();
+    const int * assignment = &assignments[last][0];
+    int clusters = int(clusterings[last].size());
+
+    // BLOCKED: [begin, end) are layers of tiles along the first way, whose
+    // rows are walked tile after tile as they are stored
+    if(matrix.layout == HyperMatrix<Data::T>::BLOCKED)
+    {
+      Indexer::tuple_t first(ways, 0);
+      Indexer::tuple_t past(dimensions);
+      first[0] = int(begin) * matrix.spans[0];
+      past[0] = min(dimensions[0], int(end) * matrix.spans[0]);
+      for(TileWalker walker(matrix.spans, first, past); !walker.end();
+          walker.forward())
+      {
+        const Indexer::tuple_t & tuple = walker.get_tuple();
+        int block = 0;
+        index_t offset = matrix.positions[last][tuple[last]];
+        for(int way = 0; way != last; ++way)
+        {
+          block = block * int(clusterings[way].size()) +
+            assignments[way][tuple[way]];
+          offset += matrix.positions[way][tuple[way]];
+        }
+        index_t * row = &table[0] + index_t(block) * clusters * values;
+        const Data::T * cells = &matrix.data[0] + offset;
+        const int * units = assignment + tuple[last];
+        for(int u = 0; u != walker.length(); ++u)
+          ++row[units[u] * values + cells[u]];
+      }
+      return;
+    }
+
+    // rows are the tuples of the ways but last (last way stays at zero)
+    Indexer::dimensions_t rows(dimensions);
+    rows[last] = 1;
+    Indexer::tuple_t tuple = row_tuple(begin);
+    int units = dimensions[last];
+    for(index_t r = begin; r != end; ++r)
+    {
+      // block of the row and offset of its first cell
+      int block = 0;
+      index_t offset = 0;
+      for(int way = 0; way != last; ++way)
+      {
+        block = block * int(clusterings[way].size()) +
+          assignments[way][tuple[way]];
+        offset += matrix.positions[way][tuple[way]];
+      }
+      index_t * row = &table[0] + index_t(block) * clusters * values;
+      const Data::T * cells = &matrix.data[0] + offset;
+      for(int u = 0; u != units; ++u)
+        ++row[assignment[u] * values + cells[u]];
+      next_tuple(tuple, rows);
+    }
+  }
+
+  void Multiclustering::count_binary_blocks
+  (counts_t & table, index_t begin, index_t end) const
+  // Library facilities used: none
+  {
+    const BinaryHyperMatrix & matrix = data->binary;
+    int ways = data->ways();
+    int last = ways - 1;
+    int values = data->values;
+    const vector<int> & dimensions = data->dimensions();
+
+    // units of each cluster of the last way
+    int clusters = int(clusterings[last].size());
+    vector<BinaryHyperMatrix::mask_t> masks(clusters);
+    for(int c = 0; c != clusters; ++c)
+      matrix.mask(clusterings[last][c], masks[c]);
+
+    // ones of each row in each cluster of the last way (rows in flat order)
+    Indexer::dimensions_t rows(dimensions);
+    rows[last] = 1;
+    Indexer::tuple_t tuple = row_tuple(begin);
+    for(index_t r = begin; r != end; ++r)
+    {
+      int block = 0;
+      for(int way = 0; way != last; ++way)
+        block = block * int(clusterings[way].size()) +
+          assignments[way][tuple[way]];
+      index_t * row = &table[0] + index_t(block) * clusters * values;
+      for(int c = 0; c != clusters; ++c)
+        row[c * values + 1] += matrix.count(size_t(r), masks[c]);
+      next_tuple(tuple, rows);
+    }
+  }
+
+  void Multiclustering::count_sparse_blocks
+  (counts_t & table, index_t begin, index_t end) const
+  // Library facilities used: none
+  {
+    int ways = data->ways();
+    if(ways == 2) {count_ranked_sparse_blocks<2>(table, begin, end); return;}
+    if(ways == 3) {count_ranked_sparse_blocks<3>(table, begin, end); return;}
+
+    const SparseHyperMatrix<Data::T> & matrix = data->sparse;
+    int values = data->values;
+    for(size_t i = size_t(begin); i != size_t(end); ++i)
+    {
+      const int * cell = matrix.tuple(i);
+      int block = 0;
+      for(int way = 0; way != ways; ++way)
+        block = block * int(clusterings[way].size()) +
+          assignments[way][cell[way]];
+      ++table[size_t(block) * values + matrix.data[i]];
+    }
+  }
+
+  template<int Ways>
+  void Multiclustering::count_ranked_sparse_blocks
+  (counts_t & table, index_t begin, index_t end) const
+  // Library facilities used: none
+  {
+    const SparseHyperMatrix<Data::T> & matrix = data->sparse;
+    const int * cells = matrix.coordinates.begin();
+    const Data::T * entries = matrix.data.begin();
+    index_t * counts = &table[0];
+    int values = data->values;
+    Blocking<Ways> blocking;
+    get_blocking(blocking, -1);
+    for(size_t i = size_t(begin); i != size_t(end); ++i)
+      ++counts[size_t(blocking.block(cells + i * Ways)) * values +
+        entries[i]];
+  }
+
+  Indexer::tuple_t Multiclustering::row_tuple(index_t row) const
+  // Library facilities used: none
+  {
+    int ways = data->ways();
+    Indexer::tuple_t tuple(ways);
+    for(int way = ways - 2; way >= 0; --way)
+    {
+      tuple[way] = int(row % data->dimensions()[way]);
+      row /= data->dimensions()[way];
+    }
+    return tuple;
+  }
+
+  void Multiclustering::count_tiled_blocks(counts_t & table) const
+  // Library facilities used: none
+  {
+    int ways = data->ways();
+    if(ways == 2) {count_ranked_tiled_blocks<2>(table); return;}
+    if(ways == 3) {count_ranked_tiled_blocks<3>(table); return;}
+
+    const TiledHyperMatrix & matrix = data->tiled;
+    int values = data->values;
+    const vector<int> & dimensions = data->dimensions();
+    Indexer::dimensions_t blocking = blocking_dimensions();
+
+    // visit cells in flat order, one tile at a time
+    Indexer::tuple_t tuple(ways);
+    for(size_t t = 0; t != matrix.tiles(); ++t)
+    {
+      const TiledHyperMatrix::cell_t * cells = matrix.tile(t);
+      for(size_t i = 0; i != matrix.tile_size(t); ++i)
+      {
+        int index = 0;
+        for(int way = 0; way != ways; ++way)
+          index = index * blocking[way] + assignments[way][tuple[way]];
+        ++table[size_t(index) * values + cells[i]];
+        next_tuple(tuple, dimensions);
+      }
+    }
+  }
+
+  template<int Ways>
+  void Multiclustering::count_ranked_tiled_blocks(counts_t & table) const
+  // Library facilities used: none
+  {
+    const TiledHyperMatrix & matrix = data->tiled;
+    index_t * counts = &table[0];
+    int values = data->values;
+    Blocking<Ways> blocking;
+    get_blocking(blocking, -1);
+
+    // visit cells in flat order, one tile at a time
+    int tuple[Ways] = {0};
+    size_t tiles = matrix.tiles();
+    for(size_t t = 0; t != tiles; ++t)
+    {
+      const TiledHyperMatrix::cell_t * cells = matrix.tile(t);
+      size_t size = matrix.tile_size(t);
+      for(size_t i = 0; i != size; ++i)
+      {
+        ++counts[size_t(blocking.block(tuple)) * values + cells[i]];
+        blocking.next(tuple);
+      }
+    }
+  }
+
+  vector<double> n_log_n_table;
+  vector<double> log_table;
+
+  void grow_log_tables(index_t size)
+  // Library facilities used: log
+  {
+    size_t entries = size_t(min(size, LOG_TABLE_SIZE - 1) + 1);
+    if(entries <= log_table.size()) return;
+    size_t n = log_table.size();
+    n_log_n_table.resize(entries);
+    log_table.resize(entries);
+    if(n == 0)
     {
-      vector<int> dimensions = data->dimensions();
-      ++counts[data->matrix[hyper_index(indexer.get_tuple(), dimensions)]];
-      indexer.forward();
+      n_log_n_table[0] = 0;
+      log_table[0] = 0;  // unused: counts of zero contribute nothing
+      n = 1;
     }
+    for(; n != entries; ++n)
+    {
+      log_table[n] = log(double(n));
+      n_log_n_table[n] = double(n) * log_table[n];
+    }
+  }
+
+  double hoffman_coding(const counts_t & counts)
+  // Library facilities used: none
+  {
+    return counts.empty() ? 0 : hoffman_coding(&counts[0], counts.size());
   }
 
-  double hoffman_coding(const vector<int> & counts)
+  double hoffman_coding(const index_t * counts, size_t size)
+  // Library facilities used: none
+  // sum of c ln(total / c) = total ln(total) - sum of c ln(c)
   {
-    int total = 0;
-    for(size_t value = 0; value != counts.size(); ++value)
-      total += counts[value];
+    index_t total = 0;
     double cost = 0;
-    for(size_t v = 0; v != counts.size(); ++v)
-      cost += hoffman_coding(counts[v], frequency(counts[v], total));
-    return cost;
+    for(size_t v = 0; v != size; ++v)
+    {
+      total += counts[v];
+      cost -= n_log_n(counts[v]);
+    }
+    return cost + n_log_n(total);
   }
 
   double hoffman_coding
-  (const vector<int> & counts, const vector<double> & frequencies)
+  (const counts_t & counts, const vector<double> & frequencies)
   // Library facilities used: assert
   {
     assert(counts.size() == frequencies.size());
@@ -124,20 +549,24 @@ namespace rlair_multi_clustering
   }
  
   double hoffman_coding
-  (const vector<int> & unit_counts, const vector<int> & block_counts)
+  (const counts_t & unit_counts, const counts_t & block_counts)
   // Library facilities used: assert
   {
     assert(unit_counts.size() == block_counts.size());
-    int total = 0;
+    index_t total = 0;
     for(size_t i = 0; i != block_counts.size(); ++i) total += block_counts[i];
+    double log_total = total == 0 ? 0 : log_count(total);
     double cost = 0;
     for(size_t i = 0; i != unit_counts.size(); ++i)
-      cost +=
-        hoffman_coding(unit_counts[i], frequency(block_counts[i], total));
+    {
+      if(unit_counts[i] == 0) continue;
+      if(block_counts[i] == 0) cost += DBL_MAX;
+      else cost += unit_counts[i] * (log_total - log_count(block_counts[i]));
+    }
     return cost;
   }
  
-  double hoffman_coding(int count, double frequency)
+  double hoffman_coding(index_t count, double frequency)
   // Library facilities used: assert, log
   {
     if(count == 0) return 0;
@@ -145,7 +574,7 @@ namespace rlair_multi_clustering
     return count * -log(frequency);
   }
 
-  double frequency(int count, int total)
+  double frequency(index_t count, index_t total)
   // Library facilities used: none
   {return count / double(total);}
 }
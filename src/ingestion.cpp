@@ -0,0 +1,371 @@
+#include <map>                  // provides: map
+#include <set>                  // provides: set
+#include <algorithm>            // provides: find, copy, upper_bound
+#include "Multiclustering.h"
+
+using namespace std;
+
+namespace rlair_multi_clustering
+{
+  int Multiclustering::ingest(const vector<Data::update_t> & batch)
+  // Library facilities used: map, set
+  // the cost of an update is proportional to the number of cells in the
+  // batch and in the slices of the units that move, not to the size of the
+  // matrix (except for a first call, which counts the blocks and the
+  // signatures of the units)
+  {
+    int ways = data->ways();
+    if(!counted) count_blocks();
+    if(!keeping) keep_signatures();
+
+    // last update of each cell
+    map<vector<int>, Data::T> cells;
+    for(size_t i = 0; i != batch.size(); ++i)
+      cells[batch[i].tuple] = batch[i].value == 0 ? 0 : 1;
+
+    // update counts of affected blocks and units, and collect units involved
+    vector<Data::update_t> changes;
+    vector<set<int> > units(ways);
+    Indexer::dimensions_t dimensions = blocking_dimensions();
+    Indexer::tuple_t block(ways);
+    map<vector<int>, Data::T>::const_iterator cell;
+    for(cell = cells.begin(); cell != cells.end(); ++cell)
+    {
+      Data::T old_value = data->get(cell->first);
+      if(old_value == cell->second) continue;
+      for(int way = 0; way != ways; ++way)
+      {
+        block[way] = assignments[way][cell->first[way]];
+        units[way].insert(cell->first[way]);
+      }
+      counts_t & counts = block_table[hyper_index(block, dimensions)];
+      --counts[old_value];
+      ++counts[cell->second];
+      keep_cell(cell->first, old_value, cell->second);
+      Data::update_t change = {cell->first, cell->second};
+      changes.push_back(change);
+    }
+    data->update(changes);
+    if(!changes.empty()) costed = false;
+
+    // bounded regroup: re-place only the units involved
+    int moved = 0;
+    for(int way = 0; way != ways; ++way)
+    {
+      set<int>::const_iterator unit;
+      for(unit = units[way].begin(); unit != units[way].end(); ++unit)
+        if(place(way, *unit)) ++moved;
+      keep_moves();
+    }
+    return moved;
+  }
+
+  void Multiclustering::reload(Data * data)
+  // Library facilities used: none
+  {
+    this->data = data;
+    counted = false;
+    costed = false;
+    kept.clear();
+    moving.clear();
+    keeping = false;
+  }
+
+  bool Multiclustering::place(int way, int unit)
+  // Library facilities used: none
+  {
+    int old_cluster = assignments[way][unit];
+
+    // unit signature
+    if(!keeping) keep_signatures();
+    vector<counts_t> signature;
+    kept_signature(signature, way, unit);
+
+    // move to the cluster that lowers the cost the most, if any
+    int new_cluster = old_cluster;
+    double best = 0;
+    int clusters = int(clusterings[way].size());
+    for(int cluster = 0; cluster != clusters; ++cluster)
+    {
+      if(cluster == old_cluster) continue;
+      double delta = move_cost(way, unit, cluster, signature);
+      if(delta < best)
+      {
+        best = delta;
+        new_cluster = cluster;
+      }
+    }
+    if(new_cluster == old_cluster) return false;
+    move_unit(way, unit, new_cluster, signature);
+    return true;
+  }
+
+  void Multiclustering::move_unit
+  (int way, int unit, int new_cluster, const vector<counts_t> & signature)
+  // Library facilities used: find
+  {
+    int old_cluster = assignments[way][unit];
+    cluster_t & members = clusterings[way][old_cluster];
+    int index =
+      int(find(members.begin(), members.end(), unit) - members.begin());
+    int values = data->values;
+    int blocks = blocking_size(way);
+
+    // move unit counts
+    for(int b = 0; b != blocks; ++b)
+    {
+      counts_t & from = block_table[block_index(way, old_cluster, b)];
+      counts_t & to = block_table[block_index(way, new_cluster, b)];
+      for(int v = 0; v != values; ++v)
+      {
+        from[v] -= signature[b][v];
+        to[v] += signature[b][v];
+      }
+    }
+    if(keeping) keep_move(way, unit, old_cluster, new_cluster);
+
+    // move unit
+    costed = false;
+    members.erase(members.begin() + index);
+    cluster_t & joined = clusterings[way][new_cluster];
+    joined.insert(upper_bound(joined.begin(), joined.end(), unit), unit);
+    assignments[way][unit] = new_cluster;
+
+    // erase old cluster if empty (blocks are renumbered)
+    if(clusterings[way][old_cluster].empty())
+    {
+      counts_t signatures;
+      get_way_signatures(signatures, way);
+      size_t width = size_t(blocks) * values;
+      signatures.erase(signatures.begin() + old_cluster * width,
+        signatures.begin() + (old_cluster + 1) * width);
+      clusterings[way].erase(clusterings[way].begin() + old_cluster);
+      assign(way);
+      set_way_signatures(way, &signatures[0]);
+    }
+  }
+
+  bool Multiclustering::implicit_zeros() const
+  // Library facilities used: none
+  {
+    return data->storage == Data::SPARSE || data->storage == Data::BINARY;
+  }
+
+  void Multiclustering::keep_signatures()
+  // Library facilities used: copy
+  {
+    int ways = data->ways();
+    int values = data->values;
+    kept = vector<counts_t>(ways);
+    moving.clear();
+    for(int way = 0; way != ways; ++way)
+    {
+      int units = data->dimensions()[way];
+      int blocks = blocking_size(way);
+      size_t width = size_t(blocks) * values;
+      kept[way] = counts_t(size_t(units) * width);
+
+      // tiles are swept once for all the units
+      if(data->storage == Data::TILED)
+      {
+        cluster_t all(units);
+        for(int u = 0; u != units; ++u) all[u] = u;
+        vector<vector<counts_t> > signatures(units);
+        get_tiled_signatures(signatures, way, all);
+        for(int u = 0; u != units; ++u)
+          for(int b = 0; b != blocks; ++b)
+            std::copy(signatures[u][b].begin(), signatures[u][b].end(),
+              kept[way].begin() + u * width + b * values);
+        continue;
+      }
+
+      vector<int> slot(units);
+      for(int u = 0; u != units; ++u) slot[u] = u;
+      count_signatures(&kept[way][0], way, slot, 0, units);
+    }
+    keeping = true;
+  }
+
+  void Multiclustering::keep_cell(const vector<int> & tuple,
+    Data::T old_value, Data::T new_value)
+  // Library facilities used: none
+  {
+    int ways = data->ways();
+    int values = data->values;
+    bool zeros = implicit_zeros();
+    for(int way = 0; way != ways; ++way)
+    {
+      int block = 0;
+      for(int w = 0; w != ways; ++w)
+        if(w != way)
+          block = block * int(clusterings[w].size()) + assignments[w][tuple[w]];
+      index_t * counts = &kept[way][0] +
+        (size_t(tuple[way]) * blocking_size(way) + block) * values;
+      if(!zeros || old_value != 0) --counts[old_value];
+      if(!zeros || new_value != 0) ++counts[new_value];
+    }
+  }
+
+  void Multiclustering::keep_move
+  (int way, int unit, int old_cluster, int new_cluster)
+  // Library facilities used: none
+  {
+    int ways = data->ways();
+    bool zeros = implicit_zeros();
+
+    // tiles are swept once for the units of way moved in a row
+    if(data->storage == Data::TILED)
+    {
+      if(!moving.empty() && moving.begin()->first.first != way) keep_moves();
+      pair<int, int> & clusters = moving.insert(make_pair(make_pair(way, unit),
+        make_pair(old_cluster, old_cluster))).first->second;
+      clusters.second = new_cluster;
+      return;
+    }
+
+    // nonzeros of the unit (SPARSE), or every cell of its slice
+    if(data->storage == Data::SPARSE)
+    {
+      const SparseHyperMatrix<Data::T> & matrix = data->sparse;
+      const Array<size_t> & fiber = matrix.fibers[way];
+      for(size_t i = matrix.offsets[way][unit];
+          i != matrix.offsets[way][unit + 1]; ++i)
+        if(matrix.data[fiber[i]] != 0)
+          move_cell(matrix.tuple(fiber[i]), matrix.data[fiber[i]], way,
+            old_cluster, new_cluster);
+      if(matrix.extra.empty()) return;
+      const vector<size_t> & extra = matrix.extra[way][unit];
+      for(size_t i = 0; i != extra.size(); ++i)
+        if(matrix.data[extra[i]] != 0)
+          move_cell(matrix.tuple(extra[i]), matrix.data[extra[i]], way,
+            old_cluster, new_cluster);
+      return;
+    }
+    Indexer::dimensions_t dimensions = data->dimensions();
+    Indexer::mask_t mask(ways);
+    mask[way] = true;
+    Indexer indexer(dimensions, mask);
+    Indexer::tuple_t start(ways);
+    start[way] = unit;
+    for(indexer.set(start); !indexer.end(); indexer.forward())
+    {
+      const Indexer::tuple_t & tuple = indexer.get_tuple();
+      Data::T value = data->get(tuple);
+      if(!zeros || value != 0)
+        move_cell(&tuple[0], value, way, old_cluster, new_cluster);
+    }
+  }
+
+  void Multiclustering::keep_moves()
+  // Library facilities used: map
+  {
+    if(!keeping) moving.clear();
+    if(moving.empty()) return;
+
+    // first and last cluster of each unit moved (unmoved if the same)
+    int way = moving.begin()->first.first;
+    int units = data->dimensions()[way];
+    vector<int> first(units, -1);
+    vector<int> last(units, -1);
+    map<pair<int, int>, pair<int, int> >::const_iterator move;
+    for(move = moving.begin(); move != moving.end(); ++move)
+      if(move->second.first != move->second.second)
+      {
+        first[move->first.second] = move->second.first;
+        last[move->first.second] = move->second.second;
+      }
+    moving.clear();
+
+    // visit cells in flat order, one tile at a time
+    const TiledHyperMatrix & matrix = data->tiled;
+    const vector<int> & dimensions = data->dimensions();
+    Indexer::tuple_t tuple(data->ways());
+    for(size_t t = 0; t != matrix.tiles(); ++t)
+    {
+      const TiledHyperMatrix::cell_t * cells = matrix.tile(t);
+      for(size_t i = 0; i != matrix.tile_size(t); ++i)
+      {
+        if(first[tuple[way]] != -1)
+          move_cell(&tuple[0], Data::T(cells[i]), way, first[tuple[way]],
+            last[tuple[way]]);
+        next_tuple(tuple, dimensions);
+      }
+    }
+  }
+
+  void Multiclustering::move_cell(const int * tuple, Data::T value, int way,
+    int old_cluster, int new_cluster)
+  // Library facilities used: none
+  {
+    int ways = data->ways();
+    int values = data->values;
+    for(int other = 0; other != ways; ++other)
+    {
+      if(other == way) continue;
+      int from = 0;
+      int to = 0;
+      for(int w = 0; w != ways; ++w)
+        if(w != other)
+        {
+          int clusters = int(clusterings[w].size());
+          from = from * clusters +
+            (w == way ? old_cluster : assignments[w][tuple[w]]);
+          to = to * clusters +
+            (w == way ? new_cluster : assignments[w][tuple[w]]);
+        }
+      index_t * counts = &kept[other][0] +
+        size_t(tuple[other]) * blocking_size(other) * values + value;
+      --counts[size_t(from) * values];
+      ++counts[size_t(to) * values];
+    }
+  }
+
+  void Multiclustering::kept_signature
+  (vector<counts_t> & signature, int way, int unit) const
+  // Library facilities used: none
+  {
+    int ways = data->ways();
+    int values = data->values;
+    int blocks = blocking_size(way);
+    const index_t * counts = &kept[way][0] + size_t(unit) * blocks * values;
+    signature.resize(blocks);
+    for(int b = 0; b != blocks; ++b)
+      signature[b].assign(counts + b * values, counts + (b + 1) * values);
+    if(!implicit_zeros()) return;
+
+    // count of zero is the rest of the cells of the unit in each block
+    for(int b = 0; b != blocks; ++b)
+    {
+      int index = b;
+      index_t cells = 1;
+      for(int w = ways - 1; w >= 0; --w)
+        if(w != way)
+        {
+          int clusters = int(clusterings[w].size());
+          cells *= index_t(clusterings[w][index % clusters].size());
+          index /= clusters;
+        }
+      signature[b][0] = cells;
+      for(int v = 1; v != values; ++v) signature[b][0] -= signature[b][v];
+    }
+  }
+
+  int Multiclustering::block_index(int way, int cluster, int sub_index) const
+  // Library facilities used: none
+  {
+    int index = 0;
+    int stride = 1;
+    for(int w = data->ways() - 1; w >= 0; --w)
+    {
+      int clusters = int(clusterings[w].size());
+      if(w == way) index += cluster * stride;
+      else
+      {
+        index += (sub_index % clusters) * stride;
+        sub_index /= clusters;
+      }
+      stride *= clusters;
+    }
+    return index;
+  }
+}
@@ -0,0 +1,54 @@
+// FILE: kernels.h
+// Blocking of the cells of a hyper-matrix with the number of ways fixed at
+// compile time (part of the namespace rlair_multi_clustering). The sweeps
+// that visit the nonzeros (SPARSE) or the cells (TILED) one at a time are
+// instantiated for 2 and 3 ways, where the block of a cell and the next
+// cell in flat order are loops of fixed depth that the compiler unrolls;
+// the other ranks keep the loops over the ways of the data.
+
+#ifndef RLAIR_MULTI_CLUSTERING_KERNELS
+#define RLAIR_MULTI_CLUSTERING_KERNELS
+
+#include <vector>                   // provides: vector
+
+namespace rlair_multi_clustering
+{
+  // The clusters of the units of each of Ways ways; a way left out of the
+  // blocking (the way of the units whose signatures are counted) has a
+  // single cluster that holds all its units
+  template<int Ways>
+  struct Blocking
+  {
+    int dimensions[Ways];             // units of each way
+    int clusters[Ways];               // clusters of each way
+    const int * assignments[Ways];    // cluster of each unit of each way
+    std::vector<int> zeros;           // assignments of the way left out
+
+    int block(const int * tuple) const
+    // Precondition: tuple is within range of dimensions
+    // Postcondition: Return value is the flat index of the block of tuple
+    // (in the hyper-plane of the way left out, if any)
+    // Library facilities used: none
+    {
+      int index = 0;
+      for(int way = 0; way != Ways; ++way)
+        index = index * clusters[way] + assignments[way][tuple[way]];
+      return index;
+    }
+
+    void next(int * tuple) const
+    // Precondition: tuple is within range of dimensions
+    // Postcondition: tuple is the next tuple in flat (last way fastest)
+    // order, wrapping around to zero after the last one (as next_tuple)
+    // Library facilities used: none
+    {
+      for(int way = Ways - 1; way >= 0; --way)
+      {
+        if(++tuple[way] != dimensions[way]) return;
+        tuple[way] = 0;
+      }
+    }
+  };
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include <climits>                  // provides: INT_MAX
 #include <iomanip>                  // provides: setw, fixed, setprecision
 #include <cerrno>                   // provides: errno
+#include <algorithm>                // provides: min
 
 // FILES (directory creation in WIN32 / LINUX)
 #ifdef WIN32
@@ -18,10 +19,12 @@
 #ifndef WIN32
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/time.h>               // provides: gettimeofday
 #endif
 
 #include "Data.h"
 #include "Multiclustering.h"
+#include "simd.h"
 #include "print.h"
 
 using namespace std;
@@ -35,6 +38,12 @@ const string MATRIX_FILE("matrix.txt");
 const string BLOCKED_MATRIX_FILE("blocked_matrix.txt");
 const string BLOCK_MODEL_FILE("block_model.txt");
 const string BLOCK_DENSITIES_FILE("densities.txt");
+const int BENCHMARK_CLUSTERS = 64;  // clusters per way optimized by benchmark
+const int BENCHMARK_RUNS = 9;       // runs per way, the fastest is reported
+const int KERNEL_SIZE = 4096;       // entries of the arrays of kernel benchmark
+const int KERNEL_CALLS = 20000;     // calls per kernel timed by benchmark
+const int SCORE_ROWS = 16;          // rows of each side of the benchmark
+                                    // score (the arrays of KERNEL_SIZE)
 
 string bytes(size_t size)
 // Library facilities used: none
@@ -47,15 +56,26 @@ string bytes(size_t size)
   return ss.str();
 }
 
-void load_data(Data & data)
+string throughput(size_t size, double seconds)
 // Library facilities used: none
 {
-  cout << "loading data . . . ";
-  time_t start = time(NULL);
-  data.load();
-  time_t finish = time(NULL);
-  cout << bytes(data.matrix.size());
-  cout << "done " << finish - start << " seconds" << endl << endl;
+  stringstream ss;
+  if(seconds > 0) ss << fixed << setprecision(1) << size / seconds / 1048576;
+  else ss << "-";
+  ss << " MB/s";
+  return ss.str();
+}
+
+double wall_time()
+// Library facilities used: gettimeofday (clock on WIN32)
+{
+#ifndef WIN32
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec + now.tv_usec / 1e6;
+#else
+  return double(clock()) / CLOCKS_PER_SEC;
+#endif
 }
 
 string timestamp()
@@ -151,18 +171,18 @@ vector<Data::T> symmetric_encode_data(Data & data)
     for(int j = i; j != units; ++j)
     {
       index_upper[1] = j;
-      Data::T upper = data.matrix[hyper_index(index_upper, data.dimensions())];
+      Data::T upper = data.matrix(index_upper);
       index_lower[0] = j;
-      Data::T lower = data.matrix[hyper_index(index_lower, data.dimensions())];
+      Data::T lower = data.matrix(index_lower);
       if(lower == 1 && upper == 0)
       {
-        int index = hyper_index(index_upper, data.dimensions());
+        index_t index = data.matrix.offset(index_upper);
         data.matrix[index] = 1;
         symmetric_mask[index] = 1;
       }
       if(lower == 0 && upper == 1)
       {
-        int index = hyper_index(index_lower, data.dimensions());
+        index_t index = data.matrix.offset(index_lower);
         data.matrix[index] = 1;
         symmetric_mask[index] = 1;
       }
@@ -207,11 +227,133 @@ double regroup(Multiclustering & local, ostream & lout)
   return new_cost;
 }
 
-Multiclustering crossassociation_search(Data & data, ostream & lout)
+double time_optimize(const Multiclustering & start, int way, double & cost)
+// Precondition: way is within range of the ways of the data of start
+// Postcondition: Return value is the fastest of BENCHMARK_RUNS calls of
+// optimize(way) on copies of start (seconds); cost is the cost after it
+// Library facilities used: wall_time, min
+{
+  double best = DBL_MAX;
+  for(int run = 0; run != BENCHMARK_RUNS; ++run)
+  {
+    Multiclustering local = start;
+    double begin = wall_time();
+    local.optimize(way);
+    best = min(best, wall_time() - begin);
+    cost = local.cost();
+  }
+  return best;
+}
+
+void benchmark_kernels(Data & data, Options & options, ostream & lout)
+// Precondition: data is loaded
+// Postcondition: the time of a call of each kernel of simd.h and of
+// optimize(way) for each way is reported for each version the CPU supports
+// (the dot product, and so the costs, are the same for all versions); score
+// is timed per KERNEL_SIZE products, as many as a call of dot
+// Library facilities used: wall_time, set_simd, add_counts, dot, score,
+// time_optimize
+{
+  vector<index_t> sum(KERNEL_SIZE, 0);
+  vector<index_t> counts(KERNEL_SIZE);
+  vector<uint16_t> narrow(KERNEL_SIZE);
+  vector<double> lengths(KERNEL_SIZE);
+  vector<double> scores(SCORE_ROWS * SCORE_ROWS);
+  for(int i = 0; i != KERNEL_SIZE; ++i)
+  {
+    counts[i] = i % 7;
+    narrow[i] = uint16_t(i % 5);
+    lengths[i] = 1.0 / (i + 1);
+  }
+
+  vector<int> clusters(data.ways());
+  for(int way = 0; way != data.ways(); ++way)
+    clusters[way] = min(BENCHMARK_CLUSTERS, data.dimensions()[way]);
+  Multiclustering start(&data, &options, &lout, clusters);
+
+  simd_t widest = simd_support();
+  for(int level = SCALAR; level <= widest; ++level)
+  {
+    set_simd(simd_t(level));
+    const char * name = simd_name(simd_t(level));
+
+    // kernels
+    double begin = wall_time();
+    for(int call = 0; call != KERNEL_CALLS; ++call)
+      add_counts(&sum[0], &counts[0], KERNEL_SIZE);
+    double add_time = (wall_time() - begin) / KERNEL_CALLS;
+    double result = 0;
+    begin = wall_time();
+    for(int call = 0; call != KERNEL_CALLS; ++call)
+      result += dot(&narrow[0], &lengths[0], KERNEL_SIZE);
+    double dot_time = (wall_time() - begin) / KERNEL_CALLS;
+    begin = wall_time();
+    for(int call = 0; call != KERNEL_CALLS / SCORE_ROWS; ++call)
+      score(&narrow[0], SCORE_ROWS, &lengths[0], SCORE_ROWS,
+        KERNEL_SIZE / SCORE_ROWS, &scores[0]);
+    double score_time = (wall_time() - begin) / KERNEL_CALLS;
+    stringstream line;
+    line << "benchmark " << name << " add " << fixed << setprecision(1)
+      << add_time * 1e9 << " ns dot " << dot_time * 1e9 << " ns score "
+      << score_time * 1e9 << " ns (" << KERNEL_SIZE << " entries, dot "
+      << setprecision(6) << result / KERNEL_CALLS << ")";
+    cout << line.str() << endl;
+    lout << line.str() << endl;
+
+    // optimization pass of each way
+    for(int way = 0; way != data.ways(); ++way)
+    {
+      double cost = 0;
+      double best = time_optimize(start, way, cost);
+      stringstream pass;
+      pass << "benchmark " << name << " way " << way << " optimize "
+        << fixed << setprecision(3) << best * 1000 << " ms (cost "
+        << cost << ")";
+      cout << pass.str() << endl;
+      lout << pass.str() << endl;
+    }
+  }
+  set_simd(widest);
+}
+
+void benchmark_layouts(const Data & data, Options & options, ostream & lout)
+// Precondition: data is loaded, with DENSE or BINARY storage (the cells of
+// SPARSE or TILED data may not fit in memory)
+// Postcondition: the time of optimize(way) for each way is reported with a
+// copy of the cells stored DENSE in each layout of HyperMatrix (the costs
+// are the same for both)
+// Library facilities used: make_dense, time_optimize
+{
+  const char * names[] = {"row-major", "blocked"};
+  for(int layout = HyperMatrix<Data::T>::ROW_MAJOR;
+      layout <= HyperMatrix<Data::T>::BLOCKED; ++layout)
+  {
+    Data dense(data);
+    dense.make_dense(HyperMatrix<Data::T>::layout_t(layout));
+    vector<int> clusters(dense.ways());
+    for(int way = 0; way != dense.ways(); ++way)
+      clusters[way] = min(BENCHMARK_CLUSTERS, dense.dimensions()[way]);
+    Multiclustering start(&dense, &options, &lout, clusters);
+    for(int way = 0; way != dense.ways(); ++way)
+    {
+      double cost = 0;
+      double best = time_optimize(start, way, cost);
+      stringstream pass;
+      pass << "benchmark layout " << names[layout] << " way " << way
+        << " optimize " << fixed << setprecision(3) << best * 1000
+        << " ms (cost " << cost << ")";
+      cout << pass.str() << endl;
+      lout << pass.str() << endl;
+    }
+  }
+}
+
+Multiclustering crossassociation_search
+(Data & data, Options & options, ostream & lout)
 // Library facilities used: none
 {
   // initialize multiclustering to 1 cluster per way
-  Multiclustering global = Multiclustering(&data, &lout);
+  Multiclustering global = Multiclustering(&data, &options, &lout);
 
   double old_cost = DBL_MAX;
   double new_cost = global.cost();
@@ -283,10 +425,10 @@ Multiclustering crossassociation_search(Data & data, ostream & lout)
   return global;
 }
 
-Multiclustering manual_search(Data & data, ostream & lout)
+Multiclustering manual_search(Data & data, Options & options, ostream & lout)
 // Library facilities used: none
 {
-  Multiclustering local = Multiclustering(&data, &lout);
+  Multiclustering local = Multiclustering(&data, &options, &lout);
   Indexer::tuple_t dimension(data.ways()); 
   dimension[0] = -1; dimension[1] = -1;
   local.print_2D_slice(dimension, cout); cerr << local.cost() << endl;
@@ -302,7 +444,46 @@ Multiclustering manual_search(Data & data, ostream & lout)
 int main(int argc, char ** argv)
 {
   // Check command-line arguments
-  if(argc != 2) {cerr << "usage: " << argv[0] << " dir" << endl; exit(1);}
+  const string usage = string("usage: ") + argv[0] +
+    " dir [--sparse] [--out-of-core MB] [--no-cache] [--threads N]"
+    " [--prune] [--benchmark] [--layout row-major|blocked]";
+  if(argc < 2) {cerr << usage << endl; exit(1);}
+  Data::storage_t storage = Data::DENSE;
+  HyperMatrix<Data::T>::layout_t layout = HyperMatrix<Data::T>::ROW_MAJOR;
+  bool cache = true;
+  int threads = 1;
+  size_t budget = 0;
+  bool prune = false;
+  bool benchmark = false;
+  for(int i = 2; i != argc; ++i)
+  {
+    if(strcmp(argv[i], "--sparse") == 0) storage = Data::SPARSE;
+    else if(strcmp(argv[i], "--out-of-core") == 0 && i + 1 != argc)
+    {
+      storage = Data::TILED;
+      budget = size_t(atoi(argv[++i])) * 1048576;
+    }
+    else if(strcmp(argv[i], "--no-cache") == 0) cache = false;
+    else if(strcmp(argv[i], "--threads") == 0 && i + 1 != argc)
+      threads = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--prune") == 0) prune = true;
+    else if(strcmp(argv[i], "--benchmark") == 0) benchmark = true;
+    else if(strcmp(argv[i], "--layout") == 0 && i + 1 != argc)
+    {
+      ++i;
+      if(strcmp(argv[i], "row-major") == 0)
+        layout = HyperMatrix<Data::T>::ROW_MAJOR;
+      else if(strcmp(argv[i], "blocked") == 0)
+        layout = HyperMatrix<Data::T>::BLOCKED;
+      else {cerr << usage << endl; exit(1);}
+    }
+    else {cerr << usage << endl; exit(1);}
+  }
+  if(threads < 1) {cerr << usage << endl; exit(1);}
+
+  // the layout orders DENSE cells: not with --sparse or --out-of-core
+  if(layout == HyperMatrix<Data::T>::BLOCKED && storage != Data::DENSE)
+  {cerr << usage << endl; exit(1);}
 
   // Set up prgoram name
   string prog_name("multi-clustering");
@@ -323,28 +504,55 @@ int main(int argc, char ** argv)
   if(lout.fail()) {cout << "error opening " << log_pathname << endl; exit(1);}
   cout << "done" << endl << endl;
 
+  // Set up search options (the workers of the pool also parse the data)
+  Options options;
+  options.threads = threads;
+  options.prune = prune;
+
   // Load data
   Data data(input_dir, DATA_FILE, LABELS_FILE);
+  data.storage = storage;
+  data.layout = layout;
+  data.cache = cache;
+  data.budget = budget;
+  data.scratch = output_dir;
   cout << "loading data . . . ";
   lout << "loading data . . . ";
   time_t start = time(NULL);
-  data.load();
+  double load_start = wall_time();
+  data.load(options.threads, options.pool);
+  double load_time = wall_time() - load_start;
+
+  // Write binary cache for next load (not timed with the parse)
+  if(data.cache && !data.cached && data.storage != Data::TILED)
+    data.save_cache();
   time_t finish = time(NULL);
-  cout << bytes(data.matrix.size() * sizeof(Data::T)) << " matrix, "
-    << bytes(data.labels.size() * sizeof(string)) << " labels ";
-  lout << bytes(data.matrix.size() * sizeof(Data::T)) << " matrix, "
-    << bytes(data.labels.size() * sizeof(string)) << " labels ";
+  cout << bytes(data.memory()) << " matrix, "
+    << bytes(data.labels.bytes()) << " labels, "
+    << throughput(data.bytes, load_time) << (data.cached ? " cached " : " ");
+  lout << bytes(data.memory()) << " matrix, "
+    << bytes(data.labels.bytes()) << " labels, "
+    << throughput(data.bytes, load_time) << (data.cached ? " cached " : " ");
   cout << "done " << finish - start << " seconds" << endl << endl;
   lout << "done " << finish - start << " seconds" << endl << endl;
 
+  // Compare the versions of the kernels (and the layouts) instead of searching
+  if(benchmark)
+  {
+    benchmark_kernels(data, options, lout);
+    if(data.storage == Data::DENSE || data.storage == Data::BINARY)
+      benchmark_layouts(data, options, lout);
+    return 0;
+  }
+
   // define plane to print
   Indexer::tuple_t dimension(data.ways(), 0);
   dimension[0] = -1;
   dimension[1] = -1;
 
   // Print matrix
-  data.matrix.print_2D_slice(dimension, cout); cout << endl;
-  data.matrix.print_2D_slice(dimension, output_dir + MATRIX_FILE);
+  data.print_2D_slice(dimension, cout); cout << endl;
+  data.print_2D_slice(dimension, output_dir + MATRIX_FILE);
 
   //vector<Data::T> symmetric_mask = symmetric_encode_data(data);
   //symmetric_encode_UN_world_trade_data(data);
@@ -358,12 +566,12 @@ int main(int argc, char ** argv)
   lout << "crossassociation search . . ." << endl;
 
   start = time(NULL);
-  Multiclustering solution = crossassociation_search(data, lout);
+  Multiclustering solution = crossassociation_search(data, options, lout);
   finish = time(NULL);
 
   cerr << finish - start << " seconds" << endl;
 
-  //Multiclustering solution = manual_search(data, lout);
+  //Multiclustering solution = manual_search(data, options, lout);
 
   //// get original data back
   //for(int i = 0; i < int(symmetric_mask.size()); ++i)
@@ -380,6 +588,27 @@ int main(int argc, char ** argv)
   solution.print_block_densities(string(output_dir + BLOCK_DENSITIES_FILE));
   lout << "cost = " << solution.cost() << endl;
   lout << "time = " << finish - start << " seconds" << endl;
+  const Statistics & statistics = options.statistics;
+  lout << "costs = " << statistics.cost_hits << " hits, "
+    << statistics.cost_misses << " misses" << endl;
+  if(options.prune)
+  {
+    size_t candidates =
+      statistics.candidates_costed + statistics.candidates_pruned;
+    size_t products = statistics.products_costed + statistics.products_pruned;
+    lout << "candidates = " << statistics.candidates_costed
+      << " costed, " << statistics.candidates_pruned << " pruned ("
+      << fixed << setprecision(1)
+      << (candidates == 0 ? 0.0 :
+        100.0 * statistics.candidates_pruned / candidates)
+      << "%), " << (products == 0 ? 0.0 :
+        100.0 * statistics.products_pruned / products)
+      << "% of products skipped" << endl;
+    lout.unsetf(ios::fixed);
+  }
+  if(data.storage == Data::TILED)
+    lout << "tiles = " << data.tiled.hits << " hits, "
+      << data.tiled.misses << " misses" << endl;
   lout.close();
 
   return 0;
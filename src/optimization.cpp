@@ -1,78 +1,338 @@
 #include <ctime>                // provides: time, clock, CLOCKS_PER_SEC
+#include <algorithm>            // provides: min, max, upper_bound, sort,
+                                // find
+#include <limits>               // provides: numeric_limits
 #include "Multiclustering.h"
+#include "simd.h"
 
 using namespace std;
 
 namespace rlair_multi_clustering
 {
   bool Multiclustering::optimize(int way)
-  // Library facilities used: assert
+  // Library facilities used: assert, numeric_limits
   // this function assigns each unit to the cluster in which its encoding cost
-  // is the lowest. This function can be parallelized.
+  // is the lowest. Units are placed in parallel by the threads of the pool.
   {
     assert(way < data->ways());
 
-    // store units signatures and block frequencies
+    // unit signatures are counted in the narrowest counters that hold the
+    // cells of a unit in a block
+    index_t most = largest_count(way);
+    if(most <= numeric_limits<uint16_t>::max())
+      return sweep_way<uint16_t>(way);
+    if(most <= numeric_limits<int32_t>::max())
+      return sweep_way<int32_t>(way);
+    return sweep_way<index_t>(way);
+  }
+
+  template<class C>
+  bool Multiclustering::sweep_way(int way)
+  // Library facilities used: min, max, add_counts, grow_log_tables
+  {
+    // store units signatures and block frequencies in contiguous arrays of
+    // blocks x values entries per unit (units of each cluster in turn) and
+    // per cluster, taken from the arena (the memory of the last sweep)
     int & values = data->values;
     int blocks = blocking_size(way);
-    int & units = data->matrix.dimensions[way];
+    const int & units = data->dimensions()[way];
     int clusters = int(clusterings[way].size());
-    vector<vector<counts_t> > units_signatures
-      (units, vector<counts_t>(blocks, counts_t(values)));
-    for(int cluster = 0; cluster != clusters; ++cluster)
-      for(int i = 0; i != int(clusterings[way][cluster].size()); ++i)
-        get_unit_signature
-        (units_signatures[clusterings[way][cluster][i]], way, cluster, i);
-    vector<vector<counts_t> > clusters_signatures
-      (clusters, vector<counts_t>(blocks, counts_t(values)));
+    size_t width = size_t(blocks) * values;
+    arena.reset();
+    C * units_signatures = arena.allocate<C>(units * width);
+    get_signatures(units_signatures, way, -1);
+    index_t * clusters_signatures = arena.allocate<index_t>(clusters * width);
+    vector<int> first(clusters + 1, 0);
     for(int c = 0; c != clusters; ++c)
-      for(int b = 0; b != blocks; ++b)
-        for(int i = 0; i != int(clusterings[way][c].size()); ++i)
-          for(int v = 0; v != values; ++v)
-            clusters_signatures[c][b][v] +=
-            units_signatures[clusterings[way][c][i]][b][v];
+    {
+      first[c + 1] = first[c] + int(clusterings[way][c].size());
+      for(int i = first[c]; i != first[c + 1]; ++i)
+        add_counts(clusters_signatures + c * width,
+          units_signatures + i * width, width);
+    }
+
+    // cost of a unit in a cluster is the dot product of its counts with the
+    // code lengths of the values in the blocks of the cluster, ln(total /
+    // count), or DBL_MAX for a value the block does not have; the costs of
+    // all the units are the matrix product of the units signatures and the
+    // code lengths (units x clusters scores)
+    // (the log tables are grown to the largest block first, before the
+    // threads read them)
+    index_t largest = 0;
+    for(size_t block = 0; block != size_t(clusters) * blocks; ++block)
+    {
+      const index_t * counts = clusters_signatures + block * values;
+      index_t total = 0;
+      for(int v = 0; v != values; ++v) total += counts[v];
+      largest = max(largest, total);
+    }
+    grow_log_tables(largest);
+    double * lengths = arena.allocate<double>(clusters * width);
+    for(size_t block = 0; block != size_t(clusters) * blocks; ++block)
+    {
+      const index_t * counts = clusters_signatures + block * values;
+      index_t total = 0;
+      for(int v = 0; v != values; ++v) total += counts[v];
+      double log_total = total == 0 ? 0 : log_count(total);
+      for(int v = 0; v != values; ++v)
+        lengths[block * values + v] =
+          counts[v] == 0 ? DBL_MAX : log_total - log_count(counts[v]);
+    }
 
-    bool optimized = false;
+    // (when pruning, units are costed one at a time instead)
+    double * scores =
+      options->prune ? NULL : arena.allocate<double>(size_t(units) * clusters);
 
     // new clustering (assignments)
-    vector<int> new_assignments(data->matrix.dimensions[way], -1);
+    vector<int> new_assignments(units, -1);
 
-    // optimize way
-    for(int cluster = 0; cluster != clusters; ++cluster)
-      for(int i = int(clusterings[way][cluster].size()) - 1; i >= 0; --i)
-        if(
-          optimize(way, cluster, i,
-                   units_signatures, clusters_signatures, new_assignments)
-        )
-          optimized = true;
+    // optimize way (units are placed independently, split among threads)
+    int threads = options->threads < 1 ? 1 : options->threads;
+    Sweep sweep = {this, way, 0, min(units, threads * SWEEP_PARTS), first,
+      units_signatures, NULL, lengths, scores, &new_assignments, NULL, NULL};
+    vector<Candidates> candidates(options->prune ? sweep.parts : 0);
+    if(options->prune)
+    {
+      double * least = arena.allocate<double>(width);
+      for(size_t k = 0; k != width; ++k)
+      {
+        least[k] = DBL_MAX;
+        for(int c = 0; c != clusters; ++c)
+          least[k] = min(least[k], lengths[c * width + k]);
+      }
+      sweep.candidates = &candidates;
+      sweep.least = least;
+    }
+    if(units != 0)
+      options->pool.run(threads, sweep_placements<C>, &sweep,
+        sweep.parts);
+    Statistics & statistics = options->statistics;
+    for(size_t part = 0; part != candidates.size(); ++part)
+    {
+      statistics.candidates_costed += candidates[part].costed;
+      statistics.candidates_pruned += candidates[part].pruned;
+      statistics.products_costed += candidates[part].products;
+      statistics.products_pruned += candidates[part].skipped;
+    }
 
-    if(!optimized) return false;
+    int moves = 0;
+    int moved = -1;
+    for(int unit = 0; unit != units; ++unit)
+      if(new_assignments[unit] != assignments[way][unit])
+      {
+        ++moves;
+        moved = unit;
+      }
+
+    if(moves == 0) return false;
+
+    // a single unit is moved only if that lowers the cost (model included),
+    // on its own (only the blocks of its two clusters change)
+    if(moves == 1)
+    {
+      int c = assignments[way][moved];
+      const cluster_t & members = clusterings[way][c];
+      int i = first[c] +
+        int(find(members.begin(), members.end(), moved) - members.begin());
+      vector<counts_t> signature(blocks, counts_t(values));
+      for(int b = 0; b != blocks; ++b)
+        for(int v = 0; v != values; ++v)
+          signature[b][v] =
+            index_t(units_signatures[i * width + b * values + v]);
+      if(move_cost(way, moved, new_assignments[moved], signature) >= 0)
+        return false;
+      move_unit(way, moved, new_assignments[moved], signature);
+      return true;
+    }
 
     // determine number of remaining clusters
+    int old_clusters = clusters;
     clusters = 0;
     for(int i = 0; i < (int)new_assignments.size(); i++)
       if(new_assignments[i] >= clusters)
         clusters = new_assignments[i] + 1;
 
+    // block counts of the new clusters are sums of their units signatures
+    index_t * signatures = arena.allocate<index_t>(clusters * width);
+    for(int c = 0; c != old_clusters; ++c)
+      for(int i = first[c]; i != first[c + 1]; ++i)
+      {
+        int unit = clusterings[way][c][i - first[c]];
+        add_counts(signatures + new_assignments[unit] * width,
+          units_signatures + i * width, width);
+      }
+
     // define new clustering
     clusterings[way] = clustering_t(clusters, cluster_t());
     for(int i = 0; i < (int)new_assignments.size(); i++)
       clusterings[way][new_assignments[i]].push_back(i);
+    assign(way);
+    set_way_signatures(way, signatures);
 
     return true;
   }
 
+  template<class C>
+  void sweep_placements(void * sweep, int part)
+  // Library facilities used: upper_bound, score
+  {
+    Multiclustering::Sweep & s = *static_cast<Multiclustering::Sweep *>(sweep);
+    const C * signatures = static_cast<const C *>(s.signatures);
+    Multiclustering & owner = *s.owner;
+    size_t width = size_t(owner.blocking_size(s.way)) * owner.data->values;
+    size_t clusters = owner.clusterings[s.way].size();
+    index_t units = s.first.back();
+    int begin = int(units * part / s.parts);
+    int end = int(units * (part + 1) / s.parts);
+    int c = int(upper_bound(s.first.begin(), s.first.end(), begin) -
+      s.first.begin()) - 1;
+
+    // pruning: each unit drops the clusters that cannot beat its best
+    if(s.candidates != NULL)
+    {
+      for(int i = begin; i != end; ++i)
+      {
+        while(i >= s.first[c + 1]) ++c;
+        owner.place_pruned(s.way, c, i - s.first[c], signatures + i * width,
+          s.lengths, s.least, (*s.candidates)[part], *s.new_assignments);
+      }
+      return;
+    }
+
+    // costs of the units of part in every cluster, in one matrix product
+    score(signatures + begin * width, end - begin, s.lengths, clusters, width,
+      s.scores + begin * clusters);
+    for(int i = begin; i != end; ++i)
+    {
+      while(i >= s.first[c + 1]) ++c;
+      owner.optimize(s.way, c, i - s.first[c], s.scores + i * clusters,
+        *s.new_assignments);
+    }
+  }
+
+  template<class C>
+  bool Multiclustering::place_pruned(int way, int old_cluster, int index,
+    const C * counts, const double * lengths, const double * least,
+    Candidates & candidates, vector<int> & new_assignments)
+  // Library facilities used: assert, min, sort, make_pair, dot, accumulate,
+  // combine
+  {
+    assert(index < data->dimensions()[way]);
+
+    int unit = clusterings[way][old_cluster][index];
+    size_t width = size_t(blocking_size(way)) * data->values;
+    int clusters = int(clusterings[way].size());
+    // rows are costed in about PRUNE_CHUNKS chunks of whole lanes
+    size_t chunk = ((width + PRUNE_CHUNKS - 1) / PRUNE_CHUNKS + LANES - 1) /
+      LANES * LANES;
+    size_t chunks = (width + chunk - 1) / chunk;
+    size_t first = min(width, chunk);
+
+    // the best cluster is the first of least cost below DBL_MAX, as in
+    // optimize; the cluster of the unit is costed first
+    int new_cluster = -1;
+    double new_cost = DBL_MAX;
+    double cost = dot(counts, lengths + old_cluster * width, width);
+    if(cost < new_cost)
+    {
+      new_cost = cost;
+      new_cluster = old_cluster;
+    }
+    ++candidates.costed;
+    candidates.products += width;
+
+    // least cost of the unit from each chunk on (its counts by the least
+    // code lengths): a candidate costs at least its partial cost plus the
+    // rest of the chunks not costed. Bounds and costs are sums of terms
+    // that are not negative in different orders, so a candidate is only
+    // dropped when its bound exceeds the best by more than their rounding
+    double margin = 1 + 4 * double(width + LANES) * DBL_EPSILON;
+    candidates.rest.assign(chunks + 1, 0);
+    for(size_t j = chunks; j-- > 0;)
+    {
+      size_t begin = j * chunk;
+      size_t size = min(width, begin + chunk) - begin;
+      candidates.rest[j] =
+        candidates.rest[j + 1] + dot(counts + begin, least + begin, size);
+    }
+
+    // the others are bounded after their first chunk (a row of one chunk
+    // is then costed); those the cluster of the unit beats are dropped,
+    // and the rest sorted by their bound
+    candidates.lanes.assign(size_t(clusters) * LANES, 0);
+    candidates.order.clear();
+    for(int cluster = 0; cluster != clusters; ++cluster)
+      if(cluster != old_cluster)
+      {
+        double * lanes = &candidates.lanes[cluster * LANES];
+        accumulate(counts, lengths + cluster * width, first, lanes);
+        double bound = combine(lanes) + candidates.rest[1];
+        candidates.products += first;
+        if(chunks != 1 && new_cluster != -1 && bound > new_cost * margin)
+        {
+          ++candidates.pruned;
+          candidates.skipped += width - first;
+        }
+        else candidates.order.push_back(make_pair(bound, cluster));
+      }
+    sort(candidates.order.begin(), candidates.order.end());
+
+    // the cost of each candidate is completed chunk by chunk (in the order
+    // of dot, so it is the same) unless its bound beats it; once a bound in
+    // order does, so do the rest
+    for(size_t i = 0; i != candidates.order.size(); ++i)
+    {
+      int cluster = candidates.order[i].second;
+      if(chunks != 1 && new_cluster != -1 &&
+          candidates.order[i].first > new_cost * margin)
+      {
+        size_t rest = candidates.order.size() - i;
+        candidates.pruned += rest;
+        candidates.skipped += rest * (width - first);
+        break;
+      }
+      double * lanes = &candidates.lanes[cluster * LANES];
+      size_t done = first;
+      for(size_t j = 1; j < chunks; ++j)
+      {
+        if(new_cluster != -1 &&
+            combine(lanes) + candidates.rest[j] > new_cost * margin)
+          break;
+        done = min(width, done + chunk);
+        accumulate(counts + j * chunk, lengths + cluster * width + j * chunk,
+          done - j * chunk, lanes);
+      }
+      candidates.products += done - first;
+      if(done != width)
+      {
+        ++candidates.pruned;
+        candidates.skipped += width - done;
+        continue;
+      }
+      ++candidates.costed;
+      cost = combine(lanes);
+      if(cost < DBL_MAX && (new_cluster == -1 || cost < new_cost ||
+          (cost == new_cost && cluster < new_cluster)))
+      {
+        new_cost = cost;
+        new_cluster = cluster;
+      }
+    }
+
+    // re-assign
+    new_assignments[unit] = new_cluster;
+
+    // feedback
+    return (new_cluster != old_cluster);
+  }
+
   bool Multiclustering::optimize(int way, int old_cluster, int index,
-    vector<vector<counts_t> > & units_signatures,
-    vector<vector<counts_t> > & clusters_signatures,
-    vector<int> & new_assignments)
+    const double * costs, vector<int> & new_assignments)
   // Library facilities used: assert
   {
-    int & units = data->matrix.dimensions[way];
-    assert(index < units);
+    assert(index < data->dimensions()[way]);
 
     int unit = clusterings[way][old_cluster][index];
-    int blocks = blocking_size(way);
 
     // search best cluster
     int new_cluster = -1;
@@ -80,10 +340,7 @@ namespace rlair_multi_clustering
     for(int cluster = 0; cluster != int(clusterings[way].size()); ++cluster)
     {
       // cost of encoding unit in way cluster
-      double cluster_cost = 0;
-      for(int block = 0; block != blocks; ++block)
-        cluster_cost += hoffman_coding
-        (units_signatures[unit][block], clusters_signatures[cluster][block]);
+      double cluster_cost = costs[cluster];
 
       // keep track of best cluster
       if(cluster_cost < new_cost)
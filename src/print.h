@@ -40,9 +40,9 @@ namespace rlair_multi_clustering
     assert(ROW < COL);
 
     const int MAX_DIMENSION = 25;
-    if(data->matrix.dimensions[ROW] > MAX_DIMENSION)
+    if(data->dimensions()[ROW] > MAX_DIMENSION)
     {cout << "number of rows > " << MAX_DIMENSION << endl; return;}
-    if(data->matrix.dimensions[COL] > MAX_DIMENSION)
+    if(data->dimensions()[COL] > MAX_DIMENSION)
     {cout << "number of columns > " << MAX_DIMENSION << endl; return;}
 
     // get cluster_z and index_z
@@ -307,8 +307,7 @@ namespace rlair_multi_clustering
               if(ROW + COL == 2) tuple[1] = clusterings[1][cluster_z][index_z];
               if(ROW + COL == 3) tuple[0] = clusterings[0][cluster_z][index_z];
             }
-            out << setw(2) <<
-            data->matrix.data[hyper_index(tuple, data->matrix.dimensions)];
+            out << setw(2) << data->get(tuple);
           }
         }
       }
@@ -349,7 +348,7 @@ namespace rlair_multi_clustering
         for(int unit = 0; unit < units; unit++)
         {
           out << setw(6) << clusterings[way][cluster][unit] << " ";
-          out << data->labels[way][clusterings[way][cluster][unit]] << endl;
+          out << data->labels(way, clusterings[way][cluster][unit]) << endl;
         }
         if(cluster < clusters - 1) out << endl;
       }
@@ -429,7 +428,7 @@ namespace rlair_multi_clustering
           int column_cluster_elements = int(clusterings[1][column_cluster].size());
           for(int column_cluster_element = 0; column_cluster_element < column_cluster_elements; column_cluster_element++) {
             tuple[1] = clusterings[1][column_cluster][column_cluster_element];
-            if(data->matrix[hyper_index(tuple, data->matrix.dimensions)] == 0)
+            if(data->get(tuple) == 0)
               out << 0;
             else out << 1;
           }
@@ -1,12 +1,15 @@
 #include <ctime>                // provides: time, clock, CLOCKS_PER_SEC
+#include <algorithm>            // provides: copy, min, max, swap
+#include <limits>               // provides: numeric_limits
 #include "Multiclustering.h"
+#include "simd.h"
 
 using namespace std;
 
 namespace rlair_multi_clustering
 {
   bool Multiclustering::add_cluster(int way)
-  // Library facilities used: none
+  // Library facilities used: numeric_limits
   // currently, this function tries each unit in order, but this is not
   // deterministic because it depends on the order in which the data is.
   // to make it deterministic, the function could be changed to compute
@@ -19,6 +22,23 @@ namespace rlair_multi_clustering
     int cluster = split_cluster(way);
     if(cluster == -1) return false; // clusters are perfect
 
+    // unit signatures are counted in the narrowest counters that hold the
+    // cells of a unit in a block
+    index_t most = largest_count(way);
+    if(most <= numeric_limits<uint16_t>::max())
+      return split_units<uint16_t>(way, cluster);
+    if(most <= numeric_limits<int32_t>::max())
+      return split_units<int32_t>(way, cluster);
+    return split_units<index_t>(way, cluster);
+  }
+
+  template<class C>
+  bool Multiclustering::split_units(int way, int cluster)
+  // Library facilities used: copy, swap, add_counts, subtract_counts
+  {
+    counts_t signatures;
+    get_way_signatures(signatures, way);
+
     // initialize
     cluster_t new_cluster;
     int & values = data->values;
@@ -26,31 +46,31 @@ namespace rlair_multi_clustering
     cluster_t & cluster_struct = clustering[cluster];
     int units = int(cluster_struct.size());
 
-    // get units signatures and block signature
+    // get units signatures and block signature (blocks x values entries per
+    // unit, one unit after the other, in buffers of the arena)
     int blocks = blocking_size(way);
-    vector<vector<counts_t> > units_signatures
-      (units, vector<counts_t>(blocks, counts_t(values)));
-    for(int i = 0; i != units; ++i)
-      get_unit_signature(units_signatures[i], way, cluster, i);
-    vector<counts_t> cluster_signature(blocks, counts_t(values));
-    for(int b = 0; b != blocks; ++b)
-      for(int v = 0; v != values; ++v)
-        for(int u = 0; u != units; ++u)
-          cluster_signature[b][v] += units_signatures[u][b][v];
+    size_t width = size_t(blocks) * values;
+    arena.reset();
+    C * units_signatures = arena.allocate<C>(units * width);
+    get_signatures(units_signatures, way, cluster);
+    index_t * cluster_signature = arena.allocate<index_t>(width);
+    for(int u = 0; u != units; ++u)
+      add_counts(cluster_signature, units_signatures + u * width, width);
 
     // initial average cluster cost
-    double average_cluster_cost = cluster_cost(cluster_signature) / units;
+    double average_cluster_cost =
+      cluster_cost(cluster_signature, blocks) / units;
 
     // move units (from the crossassociation paper)
     int current_units = units;
+    index_t * block_counts = arena.allocate<index_t>(width);
     for(int i = units - 1; i >= 0; --i)
     {
       // update block counts minus unit counts
-      vector<counts_t> block_counts = cluster_signature;
-      for(int b = 0; b != blocks; ++b)
-        for(int v = 0; v != values; ++v)
-          block_counts[b][v] -= units_signatures[i][b][v];
-      double cost = cluster_cost(block_counts) / (current_units - 1);
+      std::copy(cluster_signature, cluster_signature + width, block_counts);
+      subtract_counts(block_counts, units_signatures + i * width, width);
+      double cost =
+        cluster_cost(block_counts, blocks) / (current_units - 1);
       
       // move unit into new cluster and remove from current cluster
       if(cost < average_cluster_cost)
@@ -58,7 +78,7 @@ namespace rlair_multi_clustering
         new_cluster.push_back(cluster_struct[i]);
         cluster_struct.erase(cluster_struct.begin() + i);
         average_cluster_cost = cost;
-        cluster_signature = block_counts;
+        swap(cluster_signature, block_counts);
         --current_units;
       }
     }
@@ -66,12 +86,25 @@ namespace rlair_multi_clustering
     // check status
     if(new_cluster.empty()) return false;
 
-    // add new cluster
+    // add new cluster (its block counts are those the split cluster lost)
     clustering.push_back(new_cluster);
+    counts_t old_signature(signatures.begin() + cluster * width,
+      signatures.begin() + (cluster + 1) * width);
+    subtract_counts(&old_signature[0], cluster_signature, width);
+    signatures.insert(signatures.end(), old_signature.begin(),
+      old_signature.end());
+    std::copy(cluster_signature, cluster_signature + width,
+      signatures.begin() + cluster * width);
 
     // erase old cluster if empty
     if(clustering[cluster].empty())
+    {
       clustering.erase(clustering.begin() + cluster);
+      signatures.erase(signatures.begin() + cluster * width,
+        signatures.begin() + (cluster + 1) * width);
+    }
+    assign(way);
+    set_way_signatures(way, &signatures[0]);
 
     return true;
   }
@@ -99,37 +132,538 @@ namespace rlair_multi_clustering
   (vector<counts_t> & signature, int way, int cluster, int unit_index)
   // Library facilities used: none
   {
-    int & values = data->values;
-    vector<int> dimensions = data->dimensions();
-    Indexer indexer = blocking_indexer(way, cluster);
-    while(!indexer.end())
+    int unit = clusterings[way][cluster][unit_index];
+    if(data->storage == Data::TILED)
     {
-      // compute value counts for way unit in block
-      vector<int> block_counts(values);
-      multicluster_t block = get_block(indexer.get_tuple());
-      Indexer unit_indexer = block_indexer(block, way, unit_index);
-      while(!unit_indexer.end())
+      // the signatures of every unit are counted in one sweep over the tiles
+      // and kept current as cells change and units move
+      if(!keeping) keep_signatures();
+      keep_moves();
+      kept_signature(signature, way, unit);
+      return;
+    }
+
+    // the sweep of get_signatures over the slice of the unit alone
+    int values = data->values;
+    vector<index_t> counts(size_t(blocking_size(way)) * values);
+    vector<int> slot(data->dimensions()[way], -1);
+    slot[unit] = 0;
+    count_signatures(&counts[0], way, slot, unit, unit + 1);
+    for(size_t b = 0; b != signature.size(); ++b)
+      signature[b].assign(counts.begin() + b * values,
+        counts.begin() + (b + 1) * values);
+  }
+
+  index_t Multiclustering::largest_count(int way) const
+  // Library facilities used: max
+  {
+    index_t most = 1;
+    for(int w = 0; w != data->ways(); ++w)
+      if(w != way)
       {
-        vector<int> tuple = unit_indexer.get_tuple();
-        ++block_counts[data->matrix[hyper_index(tuple, dimensions)]];
-        unit_indexer.forward();
+        size_t largest = 0;
+        for(size_t c = 0; c != clusterings[w].size(); ++c)
+          largest = max(largest, clusterings[w][c].size());
+        most *= index_t(largest);
       }
+    return most;
+  }
 
-      // add to unit counts
-      int index = indexer.get_sub_index();
-      signature[index] = block_counts;
+  template<class C>
+  void Multiclustering::get_signatures(C * signatures, int way, int cluster)
+  // Library facilities used: copy
+  {
+    int values = data->values;
+    int blocks = blocking_size(way);
+    size_t width = size_t(blocks) * values;
+    Sweep sweep = {this, way, cluster == -1 ? 0 : cluster, 1, vector<int>(1),
+      NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+    int last = cluster == -1 ? int(clusterings[way].size()) : cluster + 1;
+    for(int c = sweep.cluster; c != last; ++c)
+      sweep.first.push_back
+        (sweep.first.back() + int(clusterings[way][c].size()));
+    int units = sweep.first.back();
+    if(units == 0) return;
 
-      // index
-      indexer.forward();
+    // tiles are swept once for all the units
+    if(data->storage == Data::TILED)
+    {
+      cluster_t all;
+      for(int c = sweep.cluster; c != last; ++c)
+        all.insert(all.end(),
+          clusterings[way][c].begin(), clusterings[way][c].end());
+      vector<vector<counts_t> > tiled(units);
+      get_tiled_signatures(tiled, way, all);
+      for(int i = 0; i != units; ++i)
+        for(int b = 0; b != blocks; ++b)
+          std::copy(tiled[i][b].begin(), tiled[i][b].end(),
+            signatures + i * width + b * values);
+      return;
     }
+
+    // one sweep over the cells of the units, split by ranges of units of way
+    // (every part reads all rows if way is the last)
+    const vector<int> & dimensions = data->dimensions();
+    vector<int> slot(dimensions[way], -1);
+    for(int c = sweep.cluster; c != last; ++c)
+      for(int i = 0; i != int(clusterings[way][c].size()); ++i)
+        slot[clusterings[way][c][i]] = sweep.first[c - sweep.cluster] + i;
+    int threads = options->threads < 1 ? 1 : options->threads;
+    int parts = way == data->ways() - 1 ? threads : threads * SWEEP_PARTS;
+    sweep.parts = min(dimensions[way], parts);
+    sweep.signatures = signatures;
+    sweep.slot = &slot;
+    options->pool.run(threads, sweep_signatures<C>, &sweep, sweep.parts);
+  }
+
+  template<class C>
+  void sweep_signatures(void * sweep, int part)
+  // Library facilities used: none
+  {
+    Multiclustering::Sweep & s = *static_cast<Multiclustering::Sweep *>(sweep);
+    index_t units = index_t(s.slot->size());
+    int begin = int(units * part / s.parts);
+    int end = int(units * (part + 1) / s.parts);
+    s.owner->count_signatures
+      (static_cast<C *>(s.signatures), s.way, *s.slot, begin, end);
   }
 
-  double Multiclustering::cluster_cost(const vector<counts_t> & block_counts)
+  template<class C>
+  void Multiclustering::count_signatures(C * signatures, int way,
+    const vector<int> & slot, int begin, int end) const
   // Library facilities used: none
   {
+    if(data->storage == Data::SPARSE)
+      count_sparse_signatures(signatures, way, slot, begin, end);
+    else if(data->storage == Data::BINARY)
+      count_binary_signatures(signatures, way, slot, begin, end);
+    else count_dense_signatures(signatures, way, slot, begin, end);
+    if(data->storage == Data::DENSE) return;
+
+    // count of zero is the rest of the cells of the unit in each block
+    int values = data->values;
+    int ways = data->ways();
+    int blocks = blocking_size(way);
+    size_t width = size_t(blocks) * values;
+    vector<index_t> cells(blocks);
+    for(int b = 0; b != blocks; ++b)
+    {
+      int index = b;
+      cells[b] = 1;
+      for(int w = ways - 1; w >= 0; --w)
+        if(w != way)
+        {
+          int clusters = int(clusterings[w].size());
+          cells[b] *= index_t(clusterings[w][index % clusters].size());
+          index /= clusters;
+        }
+    }
+    for(int u = begin; u != end; ++u)
+      if(slot[u] != -1)
+        for(int b = 0; b != blocks; ++b)
+        {
+          C * counts = signatures + slot[u] * width + b * values;
+          counts[0] = C(cells[b]);
+          for(int v = 1; v != values; ++v) counts[0] -= counts[v];
+        }
+  }
+
+  template<class C>
+  void Multiclustering::count_dense_signatures(C * signatures, int way,
+    const vector<int> & slot, int begin, int end) const
+  // Library facilities used: TileWalker
+  {
+    const HyperMatrix<Data::T> & matrix = data->matrix;
+    int ways = data->ways();
+    int last = ways - 1;
+    int values = data->values;
+    const vector<int> & dimensions = data->dimensions();
+    size_t width = size_t(blocking_size(way)) * values;
+    const int * assignment = &assignments[last][0];
+    int clusters = int(clusterings[last].size());
+
+    // BLOCKED: the rows of the box of units [begin, end) of way are walked
+    // tile after tile as they are stored, each cell added to the block of
+    // its row (and of its cluster of the last way, unless way is last) in
+    // the signature of its unit
+    if(matrix.layout == HyperMatrix<Data::T>::BLOCKED)
+    {
+      if(begin == end) return;
+      Indexer::tuple_t first(ways, 0);
+      Indexer::tuple_t past(dimensions);
+      first[way] = begin;
+      past[way] = end;
+      for(TileWalker walker(matrix.spans, first, past); !walker.end();
+          walker.forward())
+      {
+        const Indexer::tuple_t & tuple = walker.get_tuple();
+        int block = 0;
+        index_t offset = matrix.positions[last][tuple[last]];
+        for(int w = 0; w != last; ++w)
+        {
+          if(w != way)
+            block =
+              block * int(clusterings[w].size()) + assignments[w][tuple[w]];
+          offset += matrix.positions[w][tuple[w]];
+        }
+        const Data::T * cells = &matrix.data[0] + offset;
+        int length = walker.length();
+        if(way == last)
+        {
+          C * row = signatures + index_t(block) * values;
+          const int * slots = &slot[0] + tuple[last];
+          for(int u = 0; u != length; ++u)
+            if(slots[u] != -1) ++row[slots[u] * width + cells[u]];
+        }
+        else if(slot[tuple[way]] != -1)
+        {
+          C * row = signatures + slot[tuple[way]] * width +
+            index_t(block) * clusters * values;
+          const int * units = assignment + tuple[last];
+          for(int u = 0; u != length; ++u)
+            ++row[units[u] * values + cells[u]];
+        }
+      }
+      return;
+    }
+
+    // rows are the tuples of the ways but last (last way stays at zero)
+    Indexer::dimensions_t rows(dimensions);
+    rows[last] = 1;
+    index_t size = 1;
+    for(int w = 0; w != last; ++w) size *= rows[w];
+
+    // way is last: each row adds its cells of units [begin, end) to the
+    // block of the row in their signatures
+    if(way == last)
+    {
+      Indexer::tuple_t tuple(ways);
+      for(index_t r = 0; r != size; ++r)
+      {
+        int block = 0;
+        index_t offset = 0;
+        for(int w = 0; w != last; ++w)
+        {
+          block =
+            block * int(clusterings[w].size()) + assignments[w][tuple[w]];
+          offset += matrix.positions[w][tuple[w]];
+        }
+        const Data::T * cells = &matrix.data[0] + offset;
+        C * row = signatures + index_t(block) * values;
+        for(int u = begin; u != end; ++u)
+          if(slot[u] != -1) ++row[slot[u] * width + cells[u]];
+        next_tuple(tuple, rows);
+      }
+      return;
+    }
+
+    // otherwise each unit sweeps the rows of its slice, its cells added to
+    // the blocks of the row and of the clusters of the last way
+    rows[way] = 1;
+    size /= dimensions[way];
+    for(int unit = begin; unit != end; ++unit)
+    {
+      if(slot[unit] == -1) continue;
+      C * signature = signatures + slot[unit] * width;
+      Indexer::tuple_t tuple(ways);
+      for(index_t r = 0; r != size; ++r)
+      {
+        tuple[way] = unit;
+        int block = 0;
+        index_t offset = 0;
+        for(int w = 0; w != last; ++w)
+        {
+          if(w != way)
+            block =
+              block * int(clusterings[w].size()) + assignments[w][tuple[w]];
+          offset += matrix.positions[w][tuple[w]];
+        }
+        const Data::T * cells = &matrix.data[0] + offset;
+        C * row = signature + index_t(block) * clusters * values;
+        for(int u = 0; u != dimensions[last]; ++u)
+          ++row[assignment[u] * values + cells[u]];
+        tuple[way] = 0;
+        next_tuple(tuple, rows);
+      }
+    }
+  }
+
+  template<class C>
+  void Multiclustering::count_binary_signatures(C * signatures,
+    int way, const vector<int> & slot, int begin, int end) const
+  // Library facilities used: none
+  {
+    const BinaryHyperMatrix & matrix = data->binary;
+    int ways = data->ways();
+    int last = ways - 1;
+    int values = data->values;
+    const vector<int> & dimensions = data->dimensions();
+    size_t width = size_t(blocking_size(way)) * values;
+    const int bits = BinaryHyperMatrix::BITS;
+
+    // rows are the tuples of the ways but last, numbered in flat order
+    Indexer::dimensions_t rows(dimensions);
+    rows[last] = 1;
+    index_t size = 1;
+    for(int w = 0; w != last; ++w) size *= rows[w];
+
+    // way is last: each row adds the ones of units [begin, end), visited
+    // bit by bit in the words of the row, to the block of the row
+    if(way == last)
+    {
+      Indexer::tuple_t tuple(ways);
+      for(index_t r = 0; r != size && begin != end; ++r)
+      {
+        int block = 0;
+        for(int w = 0; w != last; ++w)
+          block =
+            block * int(clusterings[w].size()) + assignments[w][tuple[w]];
+        C * row = signatures + index_t(block) * values + 1;
+        const BinaryHyperMatrix::word_t * words =
+          &matrix.data[size_t(r) * matrix.row_words];
+        for(int w = begin / bits; w <= (end - 1) / bits; ++w)
+        {
+          const BinaryHyperMatrix::word_t all = ~BinaryHyperMatrix::word_t(0);
+          BinaryHyperMatrix::word_t word = words[w];
+          if(w == begin / bits) word &= all << begin % bits;
+          if(w == (end - 1) / bits && end % bits != 0)
+            word &= ~(all << end % bits);
+          for(; word != 0; word &= word - 1)
+          {
+            int u = w * bits + lowest_bit(word);
+            if(slot[u] != -1) ++row[slot[u] * width];
+          }
+        }
+        next_tuple(tuple, rows);
+      }
+      return;
+    }
+
+    // otherwise each unit sweeps the rows of its slice, counting the ones of
+    // each row in each cluster of the last way
+    int clusters = int(clusterings[last].size());
+    vector<BinaryHyperMatrix::mask_t> masks(clusters);
+    for(int c = 0; c != clusters; ++c)
+      matrix.mask(clusterings[last][c], masks[c]);
+    rows[way] = 1;
+    size /= dimensions[way];
+    for(int unit = begin; unit != end; ++unit)
+    {
+      if(slot[unit] == -1) continue;
+      C * signature = signatures + slot[unit] * width;
+      Indexer::tuple_t tuple(ways);
+      for(index_t r = 0; r != size; ++r)
+      {
+        tuple[way] = unit;
+        int block = 0;
+        size_t index = 0;
+        for(int w = 0; w != last; ++w)
+        {
+          if(w != way)
+            block =
+              block * int(clusterings[w].size()) + assignments[w][tuple[w]];
+          index = index * dimensions[w] + tuple[w];
+        }
+        C * row = signature + index_t(block) * clusters * values + 1;
+        for(int c = 0; c != clusters; ++c)
+          row[c * values] += C(matrix.count(index, masks[c]));
+        tuple[way] = 0;
+        next_tuple(tuple, rows);
+      }
+    }
+  }
+
+  template<class C>
+  void Multiclustering::count_sparse_signatures(C * signatures,
+    int way, const vector<int> & slot, int begin, int end) const
+  // Library facilities used: none
+  {
+    int ways = data->ways();
+    if(ways == 2)
+    {
+      count_ranked_sparse_signatures<C, 2>(signatures, way, slot, begin, end);
+      return;
+    }
+    if(ways == 3)
+    {
+      count_ranked_sparse_signatures<C, 3>(signatures, way, slot, begin, end);
+      return;
+    }
+
+    const SparseHyperMatrix<Data::T> & matrix = data->sparse;
+    int values = data->values;
+    size_t width = size_t(blocking_size(way)) * values;
+    const Array<size_t> & fiber = matrix.fibers[way];
+
+    // nonzeros of each unit (in its fiber, then those set since the fibers
+    // were built), added to their blocks
+    for(int unit = begin; unit != end; ++unit)
+    {
+      if(slot[unit] == -1) continue;
+      C * signature = signatures + slot[unit] * width;
+      for(size_t i = matrix.offsets[way][unit];
+          i != matrix.offsets[way][unit + 1]; ++i)
+      {
+        const int * tuple = matrix.tuple(fiber[i]);
+        int block = 0;
+        for(int w = 0; w != ways; ++w)
+          if(w != way)
+            block = block * int(clusterings[w].size()) +
+              assignments[w][tuple[w]];
+        ++signature[index_t(block) * values + matrix.data[fiber[i]]];
+      }
+      if(matrix.extra.empty()) continue;
+      const vector<size_t> & extra = matrix.extra[way][unit];
+      for(size_t i = 0; i != extra.size(); ++i)
+      {
+        const int * tuple = matrix.tuple(extra[i]);
+        int block = 0;
+        for(int w = 0; w != ways; ++w)
+          if(w != way)
+            block = block * int(clusterings[w].size()) +
+              assignments[w][tuple[w]];
+        ++signature[index_t(block) * values + matrix.data[extra[i]]];
+      }
+    }
+  }
+
+  template<class C, int Ways>
+  void Multiclustering::count_ranked_sparse_signatures(C * signatures,
+    int way, const vector<int> & slot, int begin, int end) const
+  // Library facilities used: none
+  {
+    const SparseHyperMatrix<Data::T> & matrix = data->sparse;
+    const int * cells = matrix.coordinates.begin();
+    const Data::T * entries = matrix.data.begin();
+    const size_t * fiber = matrix.fibers[way].begin();
+    const size_t * offsets = matrix.offsets[way].begin();
+    int values = data->values;
+    size_t width = size_t(blocking_size(way)) * values;
+    Blocking<Ways> blocking;
+    get_blocking(blocking, way);
+
+    // nonzeros of each unit (in its fiber, then those set since the fibers
+    // were built), added to their blocks
+    for(int unit = begin; unit != end; ++unit)
+    {
+      if(slot[unit] == -1) continue;
+      C * signature = signatures + slot[unit] * width;
+      for(size_t i = offsets[unit]; i != offsets[unit + 1]; ++i)
+      {
+        size_t nonzero = fiber[i];
+        ++signature[index_t(blocking.block(cells + nonzero * Ways)) * values +
+          entries[nonzero]];
+      }
+      if(matrix.extra.empty()) continue;
+      const vector<size_t> & extra = matrix.extra[way][unit];
+      for(size_t i = 0; i != extra.size(); ++i)
+        ++signature[index_t(blocking.block(cells + extra[i] * Ways)) *
+          values + entries[extra[i]]];
+    }
+  }
+
+  void Multiclustering::get_tiled_signatures
+  (vector<vector<counts_t> > & signatures, int way, const cluster_t & units)
+  const
+  // Library facilities used: none
+  {
+    int ways = data->ways();
+    if(ways == 2)
+    {
+      get_ranked_tiled_signatures<2>(signatures, way, units);
+      return;
+    }
+    if(ways == 3)
+    {
+      get_ranked_tiled_signatures<3>(signatures, way, units);
+      return;
+    }
+
+    const TiledHyperMatrix & matrix = data->tiled;
+    const vector<int> & dimensions = data->dimensions();
+    int blocks = blocking_size(way);
+
+    // signature of each unit of way (-1 if not requested)
+    vector<int> slot(dimensions[way], -1);
+    for(int i = 0; i != int(units.size()); ++i)
+    {
+      slot[units[i]] = i;
+      signatures[i] = vector<counts_t>(blocks, counts_t(data->values));
+    }
+
+    // visit cells in flat order, one tile at a time
+    Indexer::tuple_t tuple(ways);
+    for(size_t t = 0; t != matrix.tiles(); ++t)
+    {
+      const TiledHyperMatrix::cell_t * cells = matrix.tile(t);
+      for(size_t i = 0; i != matrix.tile_size(t); ++i)
+      {
+        if(slot[tuple[way]] != -1)
+        {
+          int index = 0;
+          for(int w = 0; w != ways; ++w)
+            if(w != way)
+              index = index * int(clusterings[w].size()) +
+                assignments[w][tuple[w]];
+          ++signatures[slot[tuple[way]]][index][cells[i]];
+        }
+        next_tuple(tuple, dimensions);
+      }
+    }
+  }
+
+  template<int Ways>
+  void Multiclustering::get_ranked_tiled_signatures
+  (vector<vector<counts_t> > & signatures, int way, const cluster_t & units)
+  const
+  // Library facilities used: none
+  {
+    const TiledHyperMatrix & matrix = data->tiled;
+    int values = data->values;
+    int blocks = blocking_size(way);
+    size_t width = size_t(blocks) * values;
+    Blocking<Ways> blocking;
+    get_blocking(blocking, way);
+
+    // signature of each unit of way (-1 if not requested), counted in
+    // blocks x values entries per unit
+    vector<int> slot(blocking.dimensions[way], -1);
+    for(int i = 0; i != int(units.size()); ++i) slot[units[i]] = i;
+    counts_t counts(units.size() * width);
+
+    // visit cells in flat order, one tile at a time
+    int tuple[Ways] = {0};
+    size_t tiles = matrix.tiles();
+    for(size_t t = 0; t != tiles; ++t)
+    {
+      const TiledHyperMatrix::cell_t * cells = matrix.tile(t);
+      size_t size = matrix.tile_size(t);
+      for(size_t i = 0; i != size; ++i)
+      {
+        int unit = slot[tuple[way]];
+        if(unit != -1)
+          ++counts[unit * width + size_t(blocking.block(tuple)) * values +
+            cells[i]];
+        blocking.next(tuple);
+      }
+    }
+    for(int i = 0; i != int(units.size()); ++i)
+    {
+      signatures[i] = vector<counts_t>(blocks);
+      for(int b = 0; b != blocks; ++b)
+        signatures[i][b].assign(counts.begin() + i * width + b * values,
+          counts.begin() + i * width + (b + 1) * values);
+    }
+  }
+
+  double Multiclustering::cluster_cost(const index_t * block_counts,
+    int blocks)
+  // Library facilities used: none
+  {
+    int values = data->values;
     double cost = 0;
-    for(size_t b = 0; b != block_counts.size(); ++b)
-      cost += hoffman_coding(block_counts[b]);
+    for(int b = 0; b != blocks; ++b)
+      cost += hoffman_coding(block_counts + b * values, values);
     return cost;
   }
 
@@ -145,4 +679,12 @@ namespace rlair_multi_clustering
     }
     return cost;
   }
+
+  // counters of the unit signatures (see largest_count)
+  template void Multiclustering::get_signatures
+    (uint16_t * signatures, int way, int cluster);
+  template void Multiclustering::get_signatures
+    (int32_t * signatures, int way, int cluster);
+  template void Multiclustering::get_signatures
+    (index_t * signatures, int way, int cluster);
 }
@@ -0,0 +1,566 @@
+// FILE: simd.cpp (part of namespace rlair_multi_clustering)
+// Kernels over contiguous arrays (see simd.h for documentation)
+
+#include <algorithm>                // provides: min, max
+#include <vector>                   // provides: vector
+#include "simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RLAIR_MULTI_CLUSTERING_X86
+#include <immintrin.h>              // provides: AVX2 and AVX-512 intrinsics
+#endif
+
+using namespace std;
+
+namespace rlair_multi_clustering
+{
+  const size_t PANEL_BYTES = 1 << 18; // code lengths scored per panel (fit
+                                      // in the L2 cache)
+
+  template<class T>
+  double finish_dot(double * partial, const T * counts,
+    const double * lengths, size_t begin, size_t size)
+  // Precondition: partial has the LANES partial sums of the entries before
+  // begin, size - begin < LANES
+  // Postcondition: Return value is the dot product, the entries from begin
+  // added to the partial sums and these combined
+  // Library facilities used: none
+  {
+    for(size_t i = begin; i != size; ++i)
+      partial[i - begin] += double(counts[i]) * lengths[i];
+    return combine(partial);
+  }
+
+  // SCALAR
+
+  template<class T>
+  void add_counts_scalar(index_t * sum, const T * counts, size_t size)
+  // Library facilities used: none
+  {
+    for(size_t i = 0; i != size; ++i) sum[i] += counts[i];
+  }
+
+  template<class T>
+  void subtract_counts_scalar(index_t * sum, const T * counts, size_t size)
+  // Library facilities used: none
+  {
+    for(size_t i = 0; i != size; ++i) sum[i] -= counts[i];
+  }
+
+  template<class T>
+  double dot_scalar(const T * counts, const double * lengths, size_t size)
+  // Library facilities used: none
+  {
+    double partial[LANES] = {0, 0, 0, 0, 0, 0, 0, 0};
+    size_t i = 0;
+    for(; i + LANES <= size; i += LANES)
+      for(size_t j = 0; j != LANES; ++j)
+        partial[j] += double(counts[i + j]) * lengths[i + j];
+    return finish_dot(partial, counts, lengths, i, size);
+  }
+
+  template<class T>
+  void accumulate_scalar(const T * counts, const double * lengths,
+    size_t size, double * partial)
+  // Library facilities used: none
+  {
+    size_t i = 0;
+    for(; i + LANES <= size; i += LANES)
+      for(size_t j = 0; j != LANES; ++j)
+        partial[j] += double(counts[i + j]) * lengths[i + j];
+    for(; i != size; ++i) partial[i % LANES] += double(counts[i]) * lengths[i];
+  }
+
+  void tile_scalar(const double * counts, const double * lengths,
+    size_t width, size_t clusters, double * scores)
+  // Precondition: counts has 2 rows and lengths 2 rows of width entries,
+  // scores is the first of 2 rows of clusters entries
+  // Postcondition: scores[i * clusters + j] is the dot product of counts
+  // row i and lengths row j, for i, j < 2
+  // Library facilities used: none
+  {
+    double partial[4][LANES] = {{0}};
+    size_t i = 0;
+    for(; i + LANES <= width; i += LANES)
+      for(size_t k = 0; k != LANES; ++k)
+      {
+        partial[0][k] += counts[i + k] * lengths[i + k];
+        partial[1][k] += counts[i + k] * lengths[width + i + k];
+        partial[2][k] += counts[width + i + k] * lengths[i + k];
+        partial[3][k] += counts[width + i + k] * lengths[width + i + k];
+      }
+    for(size_t u = 0; u != 2; ++u)
+      for(size_t c = 0; c != 2; ++c)
+        scores[u * clusters + c] = finish_dot(partial[u * 2 + c],
+          counts + u * width, lengths + c * width, i, width);
+  }
+
+#ifdef RLAIR_MULTI_CLUSTERING_X86
+  // AVX2: four 64-bit lanes, the dot product in two registers; counts are
+  // widened to 64-bit integers or converted to doubles as they are loaded
+
+  __attribute__((target("avx2")))
+  inline __m256i wide4(const uint16_t * p)
+  {return _mm256_cvtepu16_epi64
+    (_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));}
+
+  __attribute__((target("avx2")))
+  inline __m256i wide4(const int32_t * p)
+  {return _mm256_cvtepi32_epi64
+    (_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));}
+
+  __attribute__((target("avx2")))
+  inline __m256i wide4(const index_t * p)
+  {return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));}
+
+  __attribute__((target("avx2")))
+  inline __m256d real4(const uint16_t * p)
+  {return _mm256_cvtepi32_pd(_mm_cvtepu16_epi32
+    (_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p))));}
+
+  __attribute__((target("avx2")))
+  inline __m256d real4(const int32_t * p)
+  {return _mm256_cvtepi32_pd
+    (_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));}
+
+  __attribute__((target("avx2")))
+  inline __m256d real4(const index_t * p)
+  {return _mm256_set_pd(double(p[3]), double(p[2]), double(p[1]),
+    double(p[0]));}
+
+  template<class T> __attribute__((target("avx2")))
+  void add_counts_avx2(index_t * sum, const T * counts, size_t size)
+  // Library facilities used: AVX2 intrinsics
+  {
+    size_t i = 0;
+    for(; i + 4 <= size; i += 4)
+    {
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i *>(sum + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(sum + i),
+        _mm256_add_epi64(a, wide4(counts + i)));
+    }
+    for(; i != size; ++i) sum[i] += counts[i];
+  }
+
+  template<class T> __attribute__((target("avx2")))
+  void subtract_counts_avx2(index_t * sum, const T * counts, size_t size)
+  // Library facilities used: AVX2 intrinsics
+  {
+    size_t i = 0;
+    for(; i + 4 <= size; i += 4)
+    {
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i *>(sum + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(sum + i),
+        _mm256_sub_epi64(a, wide4(counts + i)));
+    }
+    for(; i != size; ++i) sum[i] -= counts[i];
+  }
+
+  template<class T> __attribute__((target("avx2")))
+  double dot_avx2(const T * counts, const double * lengths, size_t size)
+  // Library facilities used: AVX2 intrinsics
+  {
+    __m256d low = _mm256_setzero_pd();
+    __m256d high = _mm256_setzero_pd();
+    size_t i = 0;
+    for(; i + LANES <= size; i += LANES)
+    {
+      low = _mm256_add_pd(low, _mm256_mul_pd
+        (real4(counts + i), _mm256_loadu_pd(lengths + i)));
+      high = _mm256_add_pd(high, _mm256_mul_pd
+        (real4(counts + i + 4), _mm256_loadu_pd(lengths + i + 4)));
+    }
+    double partial[LANES];
+    _mm256_storeu_pd(partial, low);
+    _mm256_storeu_pd(partial + 4, high);
+    return finish_dot(partial, counts, lengths, i, size);
+  }
+
+  template<class T> __attribute__((target("avx2")))
+  void accumulate_avx2(const T * counts, const double * lengths,
+    size_t size, double * partial)
+  // Library facilities used: AVX2 intrinsics
+  {
+    __m256d low = _mm256_loadu_pd(partial);
+    __m256d high = _mm256_loadu_pd(partial + 4);
+    size_t i = 0;
+    for(; i + LANES <= size; i += LANES)
+    {
+      low = _mm256_add_pd(low, _mm256_mul_pd
+        (real4(counts + i), _mm256_loadu_pd(lengths + i)));
+      high = _mm256_add_pd(high, _mm256_mul_pd
+        (real4(counts + i + 4), _mm256_loadu_pd(lengths + i + 4)));
+    }
+    _mm256_storeu_pd(partial, low);
+    _mm256_storeu_pd(partial + 4, high);
+    for(; i != size; ++i) partial[i % LANES] += double(counts[i]) * lengths[i];
+  }
+
+  __attribute__((target("avx2")))
+  void tile_avx2(const double * counts, const double * lengths, size_t width,
+    size_t clusters, double * scores)
+  // Library facilities used: AVX2 intrinsics
+  {
+    // the lanes of each pair are added as by dot_avx2, so scores are equal;
+    // the eight sums are independent chains of additions
+    const double * row0 = counts;
+    const double * row1 = counts + width;
+    const double * cluster0 = lengths;
+    const double * cluster1 = lengths + width;
+    __m256d low00 = _mm256_setzero_pd(), high00 = _mm256_setzero_pd();
+    __m256d low01 = _mm256_setzero_pd(), high01 = _mm256_setzero_pd();
+    __m256d low10 = _mm256_setzero_pd(), high10 = _mm256_setzero_pd();
+    __m256d low11 = _mm256_setzero_pd(), high11 = _mm256_setzero_pd();
+    size_t i = 0;
+    for(; i + LANES <= width; i += LANES)
+    {
+      __m256d count0 = _mm256_loadu_pd(row0 + i);
+      __m256d count1 = _mm256_loadu_pd(row1 + i);
+      __m256d length0 = _mm256_loadu_pd(cluster0 + i);
+      __m256d length1 = _mm256_loadu_pd(cluster1 + i);
+      low00 = _mm256_add_pd(low00, _mm256_mul_pd(count0, length0));
+      low01 = _mm256_add_pd(low01, _mm256_mul_pd(count0, length1));
+      low10 = _mm256_add_pd(low10, _mm256_mul_pd(count1, length0));
+      low11 = _mm256_add_pd(low11, _mm256_mul_pd(count1, length1));
+      count0 = _mm256_loadu_pd(row0 + i + 4);
+      count1 = _mm256_loadu_pd(row1 + i + 4);
+      length0 = _mm256_loadu_pd(cluster0 + i + 4);
+      length1 = _mm256_loadu_pd(cluster1 + i + 4);
+      high00 = _mm256_add_pd(high00, _mm256_mul_pd(count0, length0));
+      high01 = _mm256_add_pd(high01, _mm256_mul_pd(count0, length1));
+      high10 = _mm256_add_pd(high10, _mm256_mul_pd(count1, length0));
+      high11 = _mm256_add_pd(high11, _mm256_mul_pd(count1, length1));
+    }
+    double partial[4][LANES];
+    _mm256_storeu_pd(partial[0], low00);
+    _mm256_storeu_pd(partial[0] + 4, high00);
+    _mm256_storeu_pd(partial[1], low01);
+    _mm256_storeu_pd(partial[1] + 4, high01);
+    _mm256_storeu_pd(partial[2], low10);
+    _mm256_storeu_pd(partial[2] + 4, high10);
+    _mm256_storeu_pd(partial[3], low11);
+    _mm256_storeu_pd(partial[3] + 4, high11);
+    for(size_t u = 0; u != 2; ++u)
+      for(size_t c = 0; c != 2; ++c)
+        scores[u * clusters + c] = finish_dot(partial[u * 2 + c],
+          counts + u * width, lengths + c * width, i, width);
+  }
+
+  // AVX-512: eight 64-bit lanes (the conversions are the zero-masked ones,
+  // whose plain forms GCC reports as reading an uninitialized register)
+
+  const __mmask8 ALL = 0xFF;          // every lane of a conversion
+
+  __attribute__((target("avx512f")))
+  inline __m512i wide8(const uint16_t * p)
+  {return _mm512_maskz_cvtepu16_epi64(ALL,
+    _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));}
+
+  __attribute__((target("avx512f")))
+  inline __m512i wide8(const int32_t * p)
+  {return _mm512_maskz_cvtepi32_epi64(ALL,
+    _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));}
+
+  __attribute__((target("avx512f")))
+  inline __m512i wide8(const index_t * p)
+  {return _mm512_loadu_si512(p);}
+
+  __attribute__((target("avx512f")))
+  inline __m512d real8(const uint16_t * p)
+  {return _mm512_maskz_cvtepi32_pd(ALL, _mm256_cvtepu16_epi32
+    (_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))));}
+
+  __attribute__((target("avx512f")))
+  inline __m512d real8(const int32_t * p)
+  {return _mm512_maskz_cvtepi32_pd(ALL,
+    _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));}
+
+  __attribute__((target("avx512f")))
+  inline __m512d real8(const index_t * p)
+  {return _mm512_set_pd(double(p[7]), double(p[6]), double(p[5]),
+    double(p[4]), double(p[3]), double(p[2]), double(p[1]), double(p[0]));}
+
+  template<class T> __attribute__((target("avx512f")))
+  void add_counts_avx512(index_t * sum, const T * counts, size_t size)
+  // Library facilities used: AVX-512 intrinsics
+  {
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8)
+    {
+      __m512i a = _mm512_loadu_si512(sum + i);
+      _mm512_storeu_si512(sum + i, _mm512_add_epi64(a, wide8(counts + i)));
+    }
+    for(; i != size; ++i) sum[i] += counts[i];
+  }
+
+  template<class T> __attribute__((target("avx512f")))
+  void subtract_counts_avx512(index_t * sum, const T * counts, size_t size)
+  // Library facilities used: AVX-512 intrinsics
+  {
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8)
+    {
+      __m512i a = _mm512_loadu_si512(sum + i);
+      _mm512_storeu_si512(sum + i, _mm512_sub_epi64(a, wide8(counts + i)));
+    }
+    for(; i != size; ++i) sum[i] -= counts[i];
+  }
+
+  template<class T> __attribute__((target("avx512f")))
+  double dot_avx512(const T * counts, const double * lengths, size_t size)
+  // Library facilities used: AVX-512 intrinsics
+  {
+    __m512d sum = _mm512_setzero_pd();
+    size_t i = 0;
+    for(; i + LANES <= size; i += LANES)
+      sum = _mm512_add_pd(sum,
+        _mm512_mul_pd(real8(counts + i), _mm512_loadu_pd(lengths + i)));
+    double partial[LANES];
+    _mm512_storeu_pd(partial, sum);
+    return finish_dot(partial, counts, lengths, i, size);
+  }
+
+  template<class T> __attribute__((target("avx512f")))
+  void accumulate_avx512(const T * counts, const double * lengths,
+    size_t size, double * partial)
+  // Library facilities used: AVX-512 intrinsics
+  {
+    __m512d sum = _mm512_loadu_pd(partial);
+    size_t i = 0;
+    for(; i + LANES <= size; i += LANES)
+      sum = _mm512_add_pd(sum,
+        _mm512_mul_pd(real8(counts + i), _mm512_loadu_pd(lengths + i)));
+    _mm512_storeu_pd(partial, sum);
+    for(; i != size; ++i) partial[i % LANES] += double(counts[i]) * lengths[i];
+  }
+
+  __attribute__((target("avx512f")))
+  void tile_avx512(const double * counts, const double * lengths,
+    size_t width, size_t clusters, double * scores)
+  // Library facilities used: AVX-512 intrinsics
+  {
+    const double * row0 = counts;
+    const double * row1 = counts + width;
+    const double * cluster0 = lengths;
+    const double * cluster1 = lengths + width;
+    __m512d sum00 = _mm512_setzero_pd(), sum01 = _mm512_setzero_pd();
+    __m512d sum10 = _mm512_setzero_pd(), sum11 = _mm512_setzero_pd();
+    size_t i = 0;
+    for(; i + LANES <= width; i += LANES)
+    {
+      __m512d count0 = _mm512_loadu_pd(row0 + i);
+      __m512d count1 = _mm512_loadu_pd(row1 + i);
+      __m512d length0 = _mm512_loadu_pd(cluster0 + i);
+      __m512d length1 = _mm512_loadu_pd(cluster1 + i);
+      sum00 = _mm512_add_pd(sum00, _mm512_mul_pd(count0, length0));
+      sum01 = _mm512_add_pd(sum01, _mm512_mul_pd(count0, length1));
+      sum10 = _mm512_add_pd(sum10, _mm512_mul_pd(count1, length0));
+      sum11 = _mm512_add_pd(sum11, _mm512_mul_pd(count1, length1));
+    }
+    double partial[4][LANES];
+    _mm512_storeu_pd(partial[0], sum00);
+    _mm512_storeu_pd(partial[1], sum01);
+    _mm512_storeu_pd(partial[2], sum10);
+    _mm512_storeu_pd(partial[3], sum11);
+    for(size_t u = 0; u != 2; ++u)
+      for(size_t c = 0; c != 2; ++c)
+        scores[u * clusters + c] = finish_dot(partial[u * 2 + c],
+          counts + u * width, lengths + c * width, i, width);
+  }
+#endif
+
+  // SCORING: the matrix product of the counts (units x width) and the
+  // transposed code lengths (width x clusters), in panels of clusters whose
+  // code lengths stay in cache while every pair of units is scored against
+  // them, two clusters at a time (a tile). The counts of a pair are
+  // converted to doubles once per panel; rows left over use dot.
+
+  template<class T,
+    void (*Tile)(const double *, const double *, size_t, size_t, double *),
+    double (*Dot)(const T *, const double *, size_t)>
+  void score_panels(const T * counts, size_t units, const double * lengths,
+    size_t clusters, size_t width, double * scores)
+  // Precondition: same as score
+  // Postcondition: same as score, computed with Tile and Dot
+  // Library facilities used: min, max, vector
+  {
+    if(width == 0)
+    {
+      for(size_t i = 0; i != units * clusters; ++i) scores[i] = 0;
+      return;
+    }
+    size_t panel = max(size_t(2), PANEL_BYTES / (width * sizeof(double)));
+    std::vector<double> pair(2 * width);
+    for(size_t first = 0; first < clusters; first += panel)
+    {
+      size_t last = min(clusters, first + panel);
+      for(size_t u = 0; u < units; u += 2)
+      {
+        const T * rows = counts + u * width;
+        double * row = scores + u * clusters;
+        size_t c = first;
+        if(u + 1 < units && first + 1 < last)
+        {
+          for(size_t i = 0; i != 2 * width; ++i) pair[i] = double(rows[i]);
+          for(; c + 1 < last; c += 2)
+            Tile(&pair[0], lengths + c * width, width, clusters, row + c);
+        }
+        for(; c != last; ++c)
+        {
+          row[c] = Dot(rows, lengths + c * width, width);
+          if(u + 1 < units)
+            row[clusters + c] = Dot(rows + width, lengths + c * width, width);
+        }
+      }
+    }
+  }
+
+  // DISPATCH
+
+  template<class T>
+  struct Kernels
+  {
+    void (*add)(index_t *, const T *, size_t);
+    void (*subtract)(index_t *, const T *, size_t);
+    double (*dot)(const T *, const double *, size_t);
+    void (*accumulate)(const T *, const double *, size_t, double *);
+    void (*score)(const T *, size_t, const double *, size_t, size_t,
+      double *);
+  };
+
+  template<class T>
+  Kernels<T> select_kernels(simd_t level)
+  // Precondition: level <= simd_support()
+  // Postcondition: Return value has the kernels of level for counts of T
+  // Library facilities used: none
+  {
+    Kernels<T> kernels = {add_counts_scalar<T>, subtract_counts_scalar<T>,
+      dot_scalar<T>, accumulate_scalar<T>,
+      score_panels<T, tile_scalar, dot_scalar<T> >};
+#ifdef RLAIR_MULTI_CLUSTERING_X86
+    if(level == AVX2)
+    {
+      Kernels<T> avx2 = {add_counts_avx2<T>, subtract_counts_avx2<T>,
+        dot_avx2<T>, accumulate_avx2<T>,
+        score_panels<T, tile_avx2, dot_avx2<T> >};
+      kernels = avx2;
+    }
+    if(level == AVX512)
+    {
+      Kernels<T> avx512 = {add_counts_avx512<T>, subtract_counts_avx512<T>,
+        dot_avx512<T>, accumulate_avx512<T>,
+        score_panels<T, tile_avx512, dot_avx512<T> >};
+      kernels = avx512;
+    }
+#else
+    (void) level;
+#endif
+    return kernels;
+  }
+
+  // kernels in use for each type of counts (selected before main runs)
+  simd_t simd_level = simd_support();
+  Kernels<uint16_t> kernels16 = select_kernels<uint16_t>(simd_level);
+  Kernels<int32_t> kernels32 = select_kernels<int32_t>(simd_level);
+  Kernels<index_t> kernels64 = select_kernels<index_t>(simd_level);
+
+  simd_t simd_support()
+  // Library facilities used: __builtin_cpu_supports
+  {
+#ifdef RLAIR_MULTI_CLUSTERING_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) return AVX512;
+    if(__builtin_cpu_supports("avx2")) return AVX2;
+#endif
+    return SCALAR;
+  }
+
+  void set_simd(simd_t level)
+  // Library facilities used: none
+  {
+    simd_level = level;
+    kernels16 = select_kernels<uint16_t>(level);
+    kernels32 = select_kernels<int32_t>(level);
+    kernels64 = select_kernels<index_t>(level);
+  }
+
+  simd_t get_simd()
+  // Library facilities used: none
+  {
+    return simd_level;
+  }
+
+  const char * simd_name(simd_t level)
+  // Library facilities used: none
+  {
+    if(level == AVX512) return "avx512";
+    if(level == AVX2) return "avx2";
+    return "scalar";
+  }
+
+  void add_counts(index_t * sum, const uint16_t * counts, size_t size)
+  // Library facilities used: none
+  {kernels16.add(sum, counts, size);}
+
+  void add_counts(index_t * sum, const int32_t * counts, size_t size)
+  // Library facilities used: none
+  {kernels32.add(sum, counts, size);}
+
+  void add_counts(index_t * sum, const index_t * counts, size_t size)
+  // Library facilities used: none
+  {kernels64.add(sum, counts, size);}
+
+  void subtract_counts(index_t * sum, const uint16_t * counts, size_t size)
+  // Library facilities used: none
+  {kernels16.subtract(sum, counts, size);}
+
+  void subtract_counts(index_t * sum, const int32_t * counts, size_t size)
+  // Library facilities used: none
+  {kernels32.subtract(sum, counts, size);}
+
+  void subtract_counts(index_t * sum, const index_t * counts, size_t size)
+  // Library facilities used: none
+  {kernels64.subtract(sum, counts, size);}
+
+  double dot(const uint16_t * counts, const double * lengths, size_t size)
+  // Library facilities used: none
+  {return kernels16.dot(counts, lengths, size);}
+
+  double dot(const int32_t * counts, const double * lengths, size_t size)
+  // Library facilities used: none
+  {return kernels32.dot(counts, lengths, size);}
+
+  double dot(const index_t * counts, const double * lengths, size_t size)
+  // Library facilities used: none
+  {return kernels64.dot(counts, lengths, size);}
+
+  void accumulate(const uint16_t * counts, const double * lengths,
+    size_t size, double * partial)
+  // Library facilities used: none
+  {kernels16.accumulate(counts, lengths, size, partial);}
+
+  void accumulate(const int32_t * counts, const double * lengths,
+    size_t size, double * partial)
+  // Library facilities used: none
+  {kernels32.accumulate(counts, lengths, size, partial);}
+
+  void accumulate(const index_t * counts, const double * lengths,
+    size_t size, double * partial)
+  // Library facilities used: none
+  {kernels64.accumulate(counts, lengths, size, partial);}
+
+  void score(const uint16_t * counts, size_t units, const double * lengths,
+    size_t clusters, size_t width, double * scores)
+  // Library facilities used: none
+  {kernels16.score(counts, units, lengths, clusters, width, scores);}
+
+  void score(const int32_t * counts, size_t units, const double * lengths,
+    size_t clusters, size_t width, double * scores)
+  // Library facilities used: none
+  {kernels32.score(counts, units, lengths, clusters, width, scores);}
+
+  void score(const index_t * counts, size_t units, const double * lengths,
+    size_t clusters, size_t width, double * scores)
+  // Library facilities used: none
+  {kernels64.score(counts, units, lengths, clusters, width, scores);}
+}
@@ -0,0 +1,90 @@
+// FILE: simd.h
+// Kernels over contiguous arrays of counts and costs used by the search
+// (part of the namespace rlair_multi_clustering). Each kernel has a scalar
+// version and, on x86 with GCC, AVX2 and AVX-512 versions; the widest one
+// the CPU supports is selected at startup. The dot product keeps eight
+// partial sums added in the same order by every version, so the selected
+// version does not change the results.
+
+#ifndef RLAIR_MULTI_CLUSTERING_SIMD
+#define RLAIR_MULTI_CLUSTERING_SIMD
+
+#include <cstddef>                  // provides: size_t
+#include <stdint.h>                 // provides: uint16_t, int32_t
+#include "Indexer.h"                // provides: index_t
+
+namespace rlair_multi_clustering
+{
+  enum simd_t {SCALAR, AVX2, AVX512};
+
+  const size_t LANES = 8;             // partial sums of the dot product
+
+  simd_t simd_support();
+  // Precondition: none
+  // Postcondition: Return value is the widest version the CPU supports
+  void set_simd(simd_t level);
+  // Precondition: level <= simd_support()
+  // Postcondition: kernels use the version of level
+  simd_t get_simd();
+  // Precondition: none
+  // Postcondition: Return value is the version used by the kernels
+  const char * simd_name(simd_t level);
+  // Precondition: none
+  // Postcondition: Return value is the name of level (e.g., "avx2")
+
+  // The counts added or weighted may be narrow (counters of unit
+  // signatures); they are widened in the registers.
+  void add_counts(index_t * sum, const uint16_t * counts, size_t size);
+  void add_counts(index_t * sum, const int32_t * counts, size_t size);
+  void add_counts(index_t * sum, const index_t * counts, size_t size);
+  // Precondition: sum and counts point to size entries
+  // Postcondition: sum[i] += counts[i] for every i
+  void subtract_counts(index_t * sum, const uint16_t * counts, size_t size);
+  void subtract_counts(index_t * sum, const int32_t * counts, size_t size);
+  void subtract_counts(index_t * sum, const index_t * counts, size_t size);
+  // Precondition: sum and counts point to size entries
+  // Postcondition: sum[i] -= counts[i] for every i
+  double dot(const uint16_t * counts, const double * lengths, size_t size);
+  double dot(const int32_t * counts, const double * lengths, size_t size);
+  double dot(const index_t * counts, const double * lengths, size_t size);
+  // Precondition: counts and lengths point to size entries
+  // Postcondition: Return value is the sum of counts[i] * lengths[i]
+  void accumulate(const uint16_t * counts, const double * lengths,
+    size_t size, double * partial);
+  void accumulate(const int32_t * counts, const double * lengths,
+    size_t size, double * partial);
+  void accumulate(const index_t * counts, const double * lengths,
+    size_t size, double * partial);
+  // Precondition: counts and lengths point to size entries, at a multiple
+  // of LANES from the start of their rows; partial has LANES sums
+  // Postcondition: counts[i] * lengths[i] is added to partial[i % LANES]
+  // for every i, as dot adds them, so that combine(partial) after the
+  // chunks of a row is the dot product of the row
+  void score(const uint16_t * counts, size_t units, const double * lengths,
+    size_t clusters, size_t width, double * scores);
+  void score(const int32_t * counts, size_t units, const double * lengths,
+    size_t clusters, size_t width, double * scores);
+  void score(const index_t * counts, size_t units, const double * lengths,
+    size_t clusters, size_t width, double * scores);
+  // Precondition: counts has units rows and lengths has clusters rows of
+  // width entries, scores has units x clusters entries
+  // Postcondition: scores[u * clusters + c] is dot(counts + u * width,
+  // lengths + c * width, width) (the same value), computed as a matrix
+  // product blocked for the caches
+
+  inline double combine(const double * partial)
+  // Precondition: partial has LANES sums
+  // Postcondition: Return value is their total, added pairwise (lane i with
+  // lane i + 4, then the four sums as (0 + 2) + (1 + 3)) as dot adds them;
+  // it does not decrease when terms that are not negative are added to the
+  // lanes, so after the first chunks of a row it is a lower bound of the
+  // dot product of the row
+  // Library facilities used: none
+  {
+    double sums[4];
+    for(int i = 0; i != 4; ++i) sums[i] = partial[i] + partial[i + 4];
+    return (sums[0] + sums[2]) + (sums[1] + sums[3]);
+  }
+}
+
+#endif
@@ -0,0 +1,560 @@
+// FILE tester.cpp
+// Test program for the rlair_multi_clustering package: a synthetic binary
+// tensor of 2048 x 1024 x 1100 cells (more than 2^31) is stored BINARY and
+// SPARSE, and its block counts and costs are checked against their closed
+// forms; batches ingested into a small tensor are checked against the same
+// cells loaded afresh, and a tuple list that sets cells again in later
+// chunks is checked to load as if parsed in file order, and again from
+// its binary cache. Small tensors of 2, 3 and 4 ways stored SPARSE and
+// TILED (whose sweeps are specialized on the number of ways), and DENSE in
+// the BLOCKED layout, are checked against the same cells stored DENSE in
+// flat order.
+
+// FILES
+#include <cstdlib>
+#include <cstdio>                   // provides: remove
+#include <iostream>                 // provides: cout, cerr
+#include <fstream>                  // provides: ofstream
+#include <vector>                   // provides: vector
+#include <cmath>                    // provides: log, fabs
+
+#include "Data.h"
+#include "Indexer.h"
+#include "Multiclustering.h"
+
+using namespace std;
+using namespace rlair_multi_clustering;
+
+// CONSTANTS
+const int DIMENSIONS[] = {2048, 1024, 1100}; // sizes of the ways
+const index_t NONZEROS = 100000;    // ones of the tensor
+const index_t STRIDE = 2654435761U; // flat distance between the ones
+                                    // (prime to the number of cells)
+const double TOLERANCE = 1e-9;      // relative error allowed in costs
+const int SMALL[] = {30, 20, 10};   // sizes of the ways of the small tensor
+const int SMALL_CLUSTERS[] = {3, 3, 2}; // clusters of its ways
+const index_t SMALL_STEP = 7919;    // flat distance between its ones
+                                    // (prime to its number of cells)
+const int LISTED[] = {3000, 2000};  // sizes of the ways of the tuple list
+const int LINES = 400000;           // tuples of the list, listed in order
+const int LATER = 150000;           // tuples between a cell and its repeat
+const char * LIST_DIR = "bin/";     // directory of the tuple list
+const int FOURTH = 4;               // size of the fourth way of the small
+                                    // tensor of 4 ways
+const int WIDE[] = {150, 100};      // sizes of the ways of the tensor of 2
+                                    // ways in tiles (more than a tile each)
+
+int failures = 0;
+
+void check(bool condition, const char * what)
+// Library facilities used: cerr
+{
+  if(condition) return;
+  cerr << "FAILED: " << what << endl;
+  ++failures;
+}
+
+bool close_to(double value, double expected)
+// Library facilities used: fabs
+{
+  return fabs(value - expected) <= TOLERANCE * fabs(expected);
+}
+
+vector<int> tuple_of(index_t flat, const vector<int> & dimensions)
+// Precondition: flat < product of dimensions
+// Postcondition: Return value is the tuple of flat index flat
+// Library facilities used: none
+{
+  vector<int> tuple(dimensions.size());
+  for(int way = int(dimensions.size()) - 1; way >= 0; --way)
+  {
+    tuple[way] = int(flat % dimensions[way]);
+    flat /= dimensions[way];
+  }
+  return tuple;
+}
+
+void make_data(Data & data, Data::storage_t storage,
+  const vector<int> & dimensions, index_t cells)
+// Precondition: storage is BINARY or SPARSE
+// Postcondition: data holds the NONZEROS ones at multiples of STRIDE
+// (modulo cells)
+// Library facilities used: none
+{
+  data.values = 2;
+  data.storage = storage;
+  if(storage == Data::BINARY) data.binary = BinaryHyperMatrix(dimensions);
+  else data.sparse = SparseHyperMatrix<Data::T>(dimensions);
+  for(index_t n = 0; n != NONZEROS; ++n)
+  {
+    vector<int> tuple = tuple_of(n * STRIDE % cells, dimensions);
+    if(storage == Data::BINARY) data.binary.set(tuple, true);
+    else data.sparse.insert(tuple, 1);
+  }
+  if(storage == Data::SPARSE) data.sparse.compress();
+}
+
+void test_indexes(const vector<int> & dimensions, index_t cells)
+// Library facilities used: none
+{
+  vector<int> last(dimensions.size());
+  for(size_t way = 0; way != dimensions.size(); ++way)
+    last[way] = dimensions[way] - 1;
+  check(hyper_index(last, dimensions) == cells - 1,
+    "hyper_index of the last cell");
+  check(tuple_of(cells - 1, dimensions) == last, "tuple of the last cell");
+
+  // flat index of an indexer past 2^31
+  Indexer::mask_t mask(dimensions.size(), false);
+  vector<int> dims(dimensions);
+  Indexer indexer(dims, mask);
+  vector<int> tuple = tuple_of(index_t(1) << 31, dimensions);
+  indexer.set(tuple);
+  check(indexer.index() == index_t(1) << 31, "Indexer index past 2^31");
+  indexer.forward();
+  check(indexer.index() == (index_t(1) << 31) + 1,
+    "Indexer forward past 2^31");
+}
+
+void test_storage(Data::storage_t storage, const char * name,
+  const vector<int> & dimensions, index_t cells)
+// Library facilities used: log, cout
+{
+  cout << "testing " << name << " storage . . ." << endl;
+  Data data;
+  make_data(data, storage, dimensions, cells);
+
+  // cells past 2^31
+  check(data.get(tuple_of(cells - 1, dimensions)) == 0, "last cell is zero");
+  index_t far = 0;
+  for(index_t n = 0; n != NONZEROS && far <= index_t(1) << 31; ++n)
+    far = n * STRIDE % cells;
+  check(far > index_t(1) << 31 && far + 1 < cells, "a one lies past 2^31");
+  check(data.get(tuple_of(far, dimensions)) == 1, "one past 2^31 is set");
+  check(data.get(tuple_of(far + 1, dimensions)) == 0,
+    "cell after it is zero");
+
+  // one cluster per way: a single block of every cell
+  Options options;
+  options.threads = 2;
+  Multiclustering multiclustering(&data, &options, &cout);
+  counts_t counts;
+  multiclustering.get_block_counts(counts, vector<int>(dimensions.size(), 0));
+  check(counts.size() == 2, "block has two value counts");
+  check(counts[0] == cells - NONZEROS, "zeros of the block");
+  check(counts[1] == NONZEROS, "ones of the block");
+
+  // model: block type (assignments cost nothing with one cluster per way)
+  double model = log(double(cells) + 1);
+  double zeros = double(cells - NONZEROS);
+  double ones = double(NONZEROS);
+  double total = double(cells);
+  double encoding =
+    total * log(total) - zeros * log(zeros) - ones * log(ones);
+  check(close_to(multiclustering.model_encoding_cost(), model),
+    "one-cluster model cost");
+  check(close_to(multiclustering.data_encoding_cost(), encoding),
+    "one-cluster data cost");
+  check(close_to(multiclustering.cost(), model + encoding),
+    "one-cluster cost");
+
+  // two clusters per way: the blocks still hold every cell and one
+  vector<int> clusters(dimensions.size(), 2);
+  Multiclustering blocked(&data, &options, &cout, clusters);
+  index_t block_cells = 0;
+  index_t block_ones = 0;
+  Indexer::tuple_t block(dimensions.size(), 0);
+  for(int b = 0; b != 8; ++b)
+  {
+    for(size_t way = 0; way != block.size(); ++way)
+      block[way] = (b >> (block.size() - 1 - way)) & 1;
+    blocked.get_block_counts(counts, block);
+    block_cells += counts[0] + counts[1];
+    block_ones += counts[1];
+  }
+  check(block_cells == cells, "blocks cover every cell");
+  check(block_ones == NONZEROS, "blocks hold every one");
+}
+
+void make_small(Data & data, Data::storage_t storage,
+  const vector<int> & dimensions, const vector<char> & ones)
+// Precondition: ones has an entry per cell of dimensions
+// Postcondition: data holds a one at each cell set in ones
+// Library facilities used: none
+{
+  data.values = 2;
+  data.storage = storage;
+  if(storage == Data::DENSE) data.matrix = HyperMatrix<Data::T>(dimensions);
+  if(storage == Data::BINARY) data.binary = BinaryHyperMatrix(dimensions);
+  if(storage == Data::SPARSE)
+    data.sparse = SparseHyperMatrix<Data::T>(dimensions);
+  if(storage == Data::TILED)
+    data.tiled = TiledHyperMatrix(dimensions, true, LIST_DIR,
+      TiledHyperMatrix::TILE);
+  for(index_t n = 0; n != index_t(ones.size()); ++n)
+  {
+    if(!ones[n]) continue;
+    vector<int> tuple = tuple_of(n, dimensions);
+    if(storage == Data::DENSE) data.matrix(tuple) = 1;
+    if(storage == Data::BINARY) data.binary.set(tuple, true);
+    if(storage == Data::SPARSE) data.sparse.insert(tuple, 1);
+    if(storage == Data::TILED) data.tiled.set(tuple, 1);
+  }
+  if(storage == Data::SPARSE) data.sparse.compress();
+}
+
+void add_update(vector<Data::update_t> & batch, vector<char> & ones,
+  const vector<int> & dimensions, index_t n, Data::T value)
+// Precondition: n < number of cells of dimensions
+// Postcondition: batch sets the nth multiple of SMALL_STEP (modulo cells)
+// to value, as does ones
+// Library facilities used: none
+{
+  index_t flat = n * SMALL_STEP % index_t(ones.size());
+  Data::update_t update = {tuple_of(flat, dimensions), value};
+  batch.push_back(update);
+  ones[flat] = value != 0;
+}
+
+void test_ingest(Data::storage_t storage, const char * name)
+// Library facilities used: cout
+{
+  cout << "testing " << name << " ingestion . . ." << endl;
+  vector<int> dimensions(SMALL, SMALL + 3);
+  vector<char> ones(dimensions[0] * dimensions[1] * dimensions[2], 0);
+  for(index_t n = 0; n != 600; ++n)
+    ones[n * SMALL_STEP % index_t(ones.size())] = 1;
+  Data data;
+  make_small(data, storage, dimensions, ones);
+  Options options;
+  options.threads = 2;
+  vector<int> clusters(SMALL_CLUSTERS, SMALL_CLUSTERS + 3);
+  Multiclustering ingested(&data, &options, &cout, clusters);
+  int moved = 0;
+
+  // two batches of new ones, removed ones, a cell set twice and a no-op,
+  // ingested into the initial clusterings (units move)
+  for(int round = 0; round != 2; ++round)
+  {
+    vector<Data::update_t> batch;
+    for(index_t n = 0; n != 150; ++n)
+      add_update(batch, ones, dimensions, 600 + 150 * round + n, 1);
+    for(index_t n = 0; n != 80; ++n)
+      add_update(batch, ones, dimensions, 80 * round + n, 0);
+    add_update(batch, ones, dimensions, 500, 0);
+    add_update(batch, ones, dimensions, 500, 1);
+    add_update(batch, ones, dimensions, 400, 1);
+    moved += ingested.ingest(batch);
+  }
+
+  check(moved > 0, "ingestion moves units");
+
+  // same cells loaded afresh, blocks counted over them
+  Data loaded;
+  make_small(loaded, storage, dimensions, ones);
+  bool same = true;
+  for(index_t n = 0; n != index_t(ones.size()); ++n)
+    if(data.get(tuple_of(n, dimensions)) != loaded.get(tuple_of(n, dimensions)))
+      same = false;
+  check(same, "ingested cells equal loaded cells");
+  Multiclustering reloaded(ingested);
+  reloaded.reload(&loaded);
+  counts_t counts;
+  counts_t expected;
+  Indexer::tuple_t block(3);
+  bool blocks = true;
+  for(block[0] = 0; block[0] != int(ingested.clusterings[0].size()); ++block[0])
+    for(block[1] = 0; block[1] != int(ingested.clusterings[1].size());
+        ++block[1])
+      for(block[2] = 0; block[2] != int(ingested.clusterings[2].size());
+          ++block[2])
+      {
+        ingested.get_block_counts(counts, block);
+        reloaded.get_block_counts(expected, block);
+        if(counts != expected) blocks = false;
+      }
+  check(blocks, "ingested blocks equal counted blocks");
+  check(close_to(ingested.model_encoding_cost(),
+    reloaded.model_encoding_cost()), "ingested model cost");
+  check(close_to(ingested.data_encoding_cost(),
+    reloaded.data_encoding_cost()), "ingested data cost");
+  check(close_to(ingested.cost(), reloaded.cost()), "ingested cost");
+
+  // unit signatures kept through the moves equal those counted afresh
+  bool moves = true;
+  for(int way = 0; way != 3; ++way)
+    for(int unit = 0; unit != dimensions[way]; ++unit)
+      for(int c = 0; c != int(ingested.clusterings[way].size()); ++c)
+        if(!close_to(ingested.move_cost(way, unit, c) + 1,
+          reloaded.move_cost(way, unit, c) + 1)) moves = false;
+  check(moves, "ingested move costs");
+}
+
+void compare_search(Multiclustering & tested, Multiclustering & expected,
+  const string & what)
+// Precondition: tested and expected cluster the same cells in the same
+// clusters
+// Postcondition: tested is checked to have the blocks, cost and move costs
+// of expected, then the clusterings and cost after one pass of each way
+// Library facilities used: none
+{
+  const vector<int> & dimensions = expected.data->dimensions();
+  int ways = int(dimensions.size());
+  vector<int> clusters(ways);
+  index_t blocks = 1;
+  for(int way = 0; way != ways; ++way)
+  {
+    clusters[way] = int(expected.clusterings[way].size());
+    blocks *= clusters[way];
+  }
+
+  // blocks, costs and unit signatures, then one pass of each way
+  counts_t counts;
+  counts_t reference;
+  bool same = true;
+  for(index_t b = 0; b != blocks; ++b)
+  {
+    tested.get_block_counts(counts, tuple_of(b, clusters));
+    expected.get_block_counts(reference, tuple_of(b, clusters));
+    if(counts != reference) same = false;
+  }
+  check(same, ("blocks " + what).c_str());
+  check(close_to(tested.cost(), expected.cost()), ("cost " + what).c_str());
+  same = true;
+  for(int way = 0; way != ways; ++way)
+    for(int unit = 0; unit != dimensions[way]; ++unit)
+      for(int c = 0; c != clusters[way]; ++c)
+        if(!close_to(tested.move_cost(way, unit, c) + 1,
+          expected.move_cost(way, unit, c) + 1)) same = false;
+  check(same, ("move costs " + what).c_str());
+  same = true;
+  for(int way = 0; way != ways; ++way)
+  {
+    tested.optimize(way);
+    expected.optimize(way);
+    if(tested.clusterings != expected.clusterings) same = false;
+  }
+  check(same, ("clusterings " + what).c_str());
+  check(close_to(tested.cost(), expected.cost()),
+    ("optimized cost " + what).c_str());
+}
+
+void test_ranks(Data::storage_t storage, const char * name)
+// Library facilities used: cout
+{
+  cout << "testing " << name << " ranks . . ." << endl;
+  for(int ways = 2; ways <= 4; ++ways)
+  {
+    vector<int> dimensions(SMALL, SMALL + 3);
+    vector<int> clusters(SMALL_CLUSTERS, SMALL_CLUSTERS + 3);
+    dimensions.resize(ways, FOURTH);
+    clusters.resize(ways, 2);
+    index_t cells = 1;
+    for(int way = 0; way != ways; ++way) cells *= dimensions[way];
+    vector<char> ones(cells, 0);
+    for(index_t n = 0; n != cells / 3; ++n)
+      ones[n * SMALL_STEP % cells] = 1;
+    Data data;
+    Data dense;
+    make_small(data, storage, dimensions, ones);
+    make_small(dense, Data::DENSE, dimensions, ones);
+    Options options;
+    options.threads = 2;
+    Multiclustering ranked(&data, &options, &cout, clusters);
+    Multiclustering expected(&dense, &options, &cout, clusters);
+    compare_search(ranked, expected, "of each rank");
+  }
+}
+
+void test_layout()
+// Library facilities used: cout
+{
+  cout << "testing blocked layout . . ." << endl;
+  for(int ways = 2; ways <= 4; ++ways)
+  {
+    vector<int> dimensions(SMALL, SMALL + 3);
+    vector<int> clusters(SMALL_CLUSTERS, SMALL_CLUSTERS + 3);
+    if(ways == 2) dimensions.assign(WIDE, WIDE + 2);
+    dimensions.resize(ways, FOURTH);
+    clusters.resize(ways, 2);
+    index_t cells = 1;
+    for(int way = 0; way != ways; ++way) cells *= dimensions[way];
+    vector<char> ones(cells, 0);
+    for(index_t n = 0; n != cells / 3; ++n)
+      ones[n * SMALL_STEP % cells] = 1;
+    Data data;
+    Data dense;
+    make_small(data, Data::DENSE, dimensions, ones);
+    make_small(dense, Data::DENSE, dimensions, ones);
+    data.make_dense(HyperMatrix<Data::T>::BLOCKED);
+
+    // cells, and the tiles they are stored in
+    bool same = true;
+    for(index_t n = 0; n != cells; ++n)
+      if(data.get(tuple_of(n, dimensions)) != ones[n]) same = false;
+    check(same, "cells of the blocked layout");
+    index_t tiles = 1;
+    for(int way = 0; way != ways; ++way)
+      tiles *= (dimensions[way] + data.matrix.spans[way] - 1) /
+        data.matrix.spans[way];
+    check(tiles > 1 && data.matrix.size() >= size_t(cells),
+      "blocked layout has several tiles");
+
+    Options options;
+    options.threads = 2;
+    Multiclustering blocked(&data, &options, &cout, clusters);
+    Multiclustering expected(&dense, &options, &cout, clusters);
+    compare_search(blocked, expected, "of the blocked layout");
+  }
+}
+
+void test_duplicates(int values, const char * name)
+// Library facilities used: ofstream, remove, cout
+{
+  cout << "testing " << name << " duplicate tuples . . ." << endl;
+  vector<int> dimensions(LISTED, LISTED + 2);
+  index_t cells = index_t(LISTED[0]) * LISTED[1];
+
+  // cells listed in order, some listed again with another value far later
+  // (in another chunk when parsed in parallel)
+  vector<char> expected(cells, 0);
+  {
+    ofstream out((string(LIST_DIR) + "duplicates.txt").c_str());
+    out << "2 " << LISTED[0] << " " << LISTED[1] << " 2 0 1 " << values
+      << "\n";
+    for(index_t n = 0; n != LINES; ++n)
+    {
+      index_t cell = n * SMALL_STEP % cells;
+      Data::T value = Data::T(1 + n % (values - 1));
+      out << cell / LISTED[1] << " " << cell % LISTED[1] << " " << value
+        << "\n";
+      expected[cell] = 1;
+      if(n < LATER || n % 7 != 0) continue;
+      cell = (n - LATER) * SMALL_STEP % cells;
+      value = n % 49 == 0 ? 1 : 0;
+      out << cell / LISTED[1] << " " << cell % LISTED[1] << " " << value
+        << "\n";
+      expected[cell] = char(value);
+    }
+  }
+
+  // parsed by one thread and by several
+  Options options;
+  for(int threads = 1; threads <= 4; threads += 3)
+  {
+    Data data(LIST_DIR, "duplicates.txt", "duplicates_labels.txt");
+    data.cache = false;
+    data.load(threads, options.pool);
+    bool same = true;
+    for(index_t cell = 0; cell != cells; ++cell)
+      if(data.get(tuple_of(cell, dimensions)) != expected[cell]) same = false;
+    check(same, threads == 1 ? "cells of one chunk are the last listed" :
+      "cells of several chunks are the last listed");
+  }
+  remove((string(LIST_DIR) + "duplicates.txt").c_str());
+}
+
+void test_cache(Data::storage_t storage, const char * name)
+// Library facilities used: ofstream, remove, cout
+{
+  cout << "testing " << name << " cache . . ." << endl;
+  vector<int> dimensions(SMALL, SMALL + 2);
+  index_t cells = index_t(SMALL[0]) * SMALL[1];
+  string data_file = string(LIST_DIR) + "cached.txt";
+  string labels_file = string(LIST_DIR) + "cached_labels.txt";
+  {
+    ofstream out(data_file.c_str());
+    out << "2 " << SMALL[0] << " " << SMALL[1] << " 2 0 1 3\n";
+    for(index_t cell = 0; cell < cells; cell += 7)
+      out << cell / SMALL[1] << " " << cell % SMALL[1] << " "
+        << 1 + cell % 2 << "\n";
+    ofstream labels(labels_file.c_str());
+    for(int way = 0; way != 2; ++way)
+    {
+      if(way != 0) labels << "\n";
+      for(int unit = 0; unit != SMALL[way]; ++unit)
+        labels << "way" << way << "_" << unit << "\n";
+    }
+  }
+
+  // parsed, cache written, loaded again from the cache
+  Options options;
+  Data parsed(LIST_DIR, "cached.txt", "cached_labels.txt");
+  parsed.storage = storage;
+  parsed.load(1, options.pool);
+  parsed.save_cache();
+  Data cached(LIST_DIR, "cached.txt", "cached_labels.txt");
+  cached.storage = storage;
+  cached.load(1, options.pool);
+  check(!parsed.cached && cached.cached, "cache is used on the next load");
+  bool same = true;
+  for(index_t cell = 0; cell != cells; ++cell)
+    if(cached.get(tuple_of(cell, dimensions)) !=
+      parsed.get(tuple_of(cell, dimensions))) same = false;
+  check(same, "cells loaded from the cache are those parsed");
+  check(cached.labels.bytes() == 0, "labels are not read from the cache");
+  check(cached.labels(1, 3) == "way1_3", "labels are read on first use");
+
+  // a cell set in the matrix loaded from the cache leaves the cache as is
+  vector<Data::update_t> batch(1);
+  batch[0].tuple = tuple_of(0, dimensions);
+  batch[0].value = 0;
+  cached.update(batch);
+  Data again(LIST_DIR, "cached.txt", "cached_labels.txt");
+  again.storage = storage;
+  again.load(1, options.pool);
+  check(cached.get(batch[0].tuple) == 0 && again.cached &&
+    again.get(batch[0].tuple) == parsed.get(batch[0].tuple),
+    "cells set after a cached load do not change the cache");
+
+  // a load asking for another layout of the cells parses them again
+  if(storage == Data::DENSE)
+  {
+    Data blocked(LIST_DIR, "cached.txt", "cached_labels.txt");
+    blocked.storage = storage;
+    blocked.layout = HyperMatrix<Data::T>::BLOCKED;
+    blocked.load(1, options.pool);
+    same = !blocked.cached && blocked.storage == Data::DENSE &&
+      blocked.matrix.layout == HyperMatrix<Data::T>::BLOCKED;
+    for(index_t cell = 0; cell != cells; ++cell)
+      if(blocked.get(tuple_of(cell, dimensions)) !=
+        parsed.get(tuple_of(cell, dimensions))) same = false;
+    check(same, "a cache of another layout is not used");
+  }
+
+  remove(data_file.c_str());
+  remove(labels_file.c_str());
+  remove((data_file + ".cache").c_str());
+}
+
+int main()
+{
+  vector<int> dimensions(DIMENSIONS, DIMENSIONS + 3);
+  index_t cells = 1;
+  for(size_t way = 0; way != dimensions.size(); ++way)
+    cells *= dimensions[way];
+  check(cells > index_t(1) << 31, "tensor has more than 2^31 cells");
+
+  test_indexes(dimensions, cells);
+  test_storage(Data::BINARY, "binary", dimensions, cells);
+  test_storage(Data::SPARSE, "sparse", dimensions, cells);
+  test_ingest(Data::DENSE, "dense");
+  test_ingest(Data::BINARY, "binary");
+  test_ingest(Data::SPARSE, "sparse");
+  test_ingest(Data::TILED, "tiled");
+  test_ranks(Data::SPARSE, "sparse");
+  test_ranks(Data::TILED, "tiled");
+  test_layout();
+  test_duplicates(2, "binary");
+  test_duplicates(3, "dense");
+  test_cache(Data::DENSE, "dense");
+  test_cache(Data::SPARSE, "sparse");
+
+  if(failures != 0)
+  {
+    cerr << failures << " checks failed" << endl;
+    return 1;
+  }
+  cout << "all checks passed" << endl;
+  return 0;
+}